@@ -0,0 +1,53 @@
+/**
+ * Points and lines
+ *
+ * The two interfaces the adapters bridge: drawing code that only knows how to plot
+ * points, and vector data made of lines between two integer points.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct Point
+{
+    int x, y;
+
+    bool operator==(const Point& other) const { return x == other.x && y == other.y; }
+    bool operator!=(const Point& other) const { return !(*this == other); }
+};
+
+struct Line
+{
+    Point start, end;
+
+    bool operator==(const Line& other) const { return start == other.start && end == other.end; }
+    bool operator!=(const Line& other) const { return !(*this == other); }
+};
+
+// Hashes all four coordinates, for unordered containers keyed by the exact line.
+struct LineHash
+{
+    std::size_t operator()(const Line& line) const
+    {
+        uint64_t hash = mix(pack(line.start) * 0x9e3779b97f4a7c15ull);
+        return static_cast<std::size_t>(mix(hash ^ pack(line.end)));
+    }
+
+private:
+    static uint64_t pack(const Point& point)
+    {
+        return (uint64_t{static_cast<uint32_t>(point.x)} << 32) | static_cast<uint32_t>(point.y);
+    }
+
+    static uint64_t mix(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+};
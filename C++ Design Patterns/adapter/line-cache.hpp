@@ -0,0 +1,117 @@
+/**
+ * Bounded LRU cache of rasterized lines
+ *
+ * LineCache maps a Line to its points. It is keyed by the exact line, not by a hash of
+ * it, so two lines that hash alike never share an entry. Lookup and eviction are O(1):
+ *  - the entries sit in a list, most recently used first; a hit moves its entry to the
+ *    front with a splice, which moves no points;
+ *  - an unordered_map from the line to its list node finds the entry;
+ *  - the cache is bounded by the memory its points take. After an insertion, entries are
+ *    evicted from the back of the list until the total fits again. A line whose points
+ *    alone exceed the bound is returned but not kept.
+ * Entries are handed out as shared_ptrs to const points. An adapter keeps its points
+ * alive and reads them directly even after the cache has evicted them.
+ * The cache is not thread-safe.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+#include "geometry.hpp"
+#include "rasterize.hpp"
+
+struct LineCacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+
+    double hit_rate() const
+    {
+        uint64_t total = hits + misses;
+        return total ? static_cast<double>(hits) / total : 0.0;
+    }
+};
+
+class LineCache
+{
+public:
+    explicit LineCache(size_t capacity_bytes)
+        : capacity_bytes{capacity_bytes} {}
+
+    LineCache(LineCache const&) = delete;
+    void operator=(LineCache const&) = delete;
+
+    // The points of line. On a miss they are made by generate(points), which gets
+    // an empty Points to fill, and cached.
+    template <typename Generate>
+    std::shared_ptr<const Points> get(const Line& line, Generate&& generate)
+    {
+        if (auto it = index.find(line); it != index.end())
+        {
+            ++counters.hits;
+            entries.splice(entries.begin(), entries, it->second);
+            return it->second->points;
+        }
+
+        ++counters.misses;
+        auto points = std::make_shared<Points>();
+        generate(*points);
+        size_t size = bytes_of(*points);
+        if (size > capacity_bytes)
+            return points;
+
+        entries.push_front({line, points, size});
+        index.emplace(line, entries.begin());
+        bytes += size;
+        while (bytes > capacity_bytes)
+        {
+            Entry& victim = entries.back();
+            bytes -= victim.bytes;
+            index.erase(victim.line);
+            entries.pop_back();
+            ++counters.evictions;
+        }
+        return points;
+    }
+
+    void clear()
+    {
+        index.clear();
+        entries.clear();
+        bytes = 0;
+    }
+
+    size_t size() const { return entries.size(); }
+
+    // memory taken by the cached points
+    size_t size_in_bytes() const { return bytes; }
+
+    LineCacheStats stats() const { return counters; }
+
+private:
+    struct Entry
+    {
+        Line line;
+        std::shared_ptr<const Points> points;
+        size_t bytes;
+    };
+
+    static size_t bytes_of(const Points& points)
+    {
+        return points.capacity() * sizeof(Point);
+    }
+
+    const size_t capacity_bytes;
+    // most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<Line, std::list<Entry>::iterator, LineHash> index;
+    size_t bytes = 0;
+    LineCacheStats counters;
+};
@@ -12,72 +12,24 @@
  * while the `LineToPointCachingAdapter` caches the generated points to avoid redundant calculations.
  */
 
-#pragma once
-
 #include <cstddef>
+#include <memory>
 #include <vector>
-#include <map>
 #include <iostream>
-#include <boost/functional/hash.hpp>
-
-struct Point 
-{
-    int x, y;
-
-    friend std::size_t hash_value(const Point& point)
-    {
-        std::size_t seed = 0x1E44943F;
-        boost::hash_combine(seed, point.x);
-        boost::hash_combine(seed, point.y);
-        return seed;
-    }
 
-};
-
-struct Line
-{
-    Point start, end;
-
-    friend std::size_t hash_value(const Line& line)
-    {
-        std::size_t seed = 0x1E44943F;
-        boost::hash_combine(seed, line.start);
-        boost::hash_combine(seed, line.end);
-        return seed;
-    }
-};
+#include "geometry.hpp"
+#include "line-cache.hpp"
+#include "rasterize.hpp"
 
 struct LineToPointAdapter
 {
-    typedef std::vector<Point> Points;
-
     LineToPointAdapter(Line& line)
     {
         static int count = 0;
 
         std::cout << "Generating points for line (no caching)\n" << count++ << std::endl;
 
-        int left = std::min(line.start.x, line.end.x);
-        int right = std::max(line.start.x, line.end.x);
-        int top = std::min(line.start.y, line.end.y);
-        int bottom = std::max(line.start.y, line.end.y);
-        int dx = right - left;
-        int dy = line.end.y - line.start.y;
-
-        if (dx == 0)
-        {
-            for (int y = top; y <= bottom; ++y)
-            {
-                points.emplace_back(Point{ left, y });
-            }
-        }
-        else if (dy == 0)
-        {
-            for (int x = left; x <= right; ++x)
-            {
-                points.emplace_back(Point{ x, top });
-            }
-        }
+        rasterize(line, points);
     }
 
     virtual Points::iterator begin() { return points.begin(); }
@@ -89,56 +41,29 @@ private:
 
 struct LineToPointCachingAdapter
 {
-    typedef std::vector<Point> Points;
-
     LineToPointCachingAdapter(Line& line)
     {
-        boost::hash<Line> hash;
-        line_hash = hash(line);
-
-        if (cache.find(line_hash) != cache.end()) return;
-
-        static int count = 0;
-
-        std::cout << "Generating points for line (with caching)\n" << count++ << std::endl;
-
-        // No interpolation
-        Points points;
-
-        int left = std::min(line.start.x, line.end.x);
-        int right = std::max(line.start.x, line.end.x);
-        int top = std::min(line.start.y, line.end.y);
-        int bottom = std::max(line.start.y, line.end.y);
-        int dx = right - left;
-        int dy = line.end.y - line.start.y;
-
-        if (dx == 0)
-        {
-            for (int y = top; y <= bottom; ++y)
-            {
-                points.emplace_back(Point{ left, y });
-            }
-        }
-        else if (dy == 0)
+        points = cache.get(line, [&](Points& points)
         {
-            for (int x = left; x <= right; ++x)
-            {
-                points.emplace_back(Point{ x, top });
-            }
-        }
+            static int count = 0;
 
-        cache[line_hash] = points;
+            std::cout << "Generating points for line (with caching)\n" << count++ << std::endl;
 
+            rasterize(line, points);
+        });
     }
 
-    virtual Points::iterator begin() { return cache[line_hash].begin(); }
-    virtual Points::iterator end() { return cache[line_hash].end(); }
+    virtual Points::const_iterator begin() { return points->begin(); }
+    virtual Points::const_iterator end() { return points->end(); }
+
+    // shared by all the adapters, bounded to 1 MiB of points
+    inline static LineCache cache{1 << 20};
+
 private:
-    std::size_t line_hash;
-    static std::map<std::size_t, Points> cache;
+    std::shared_ptr<const Points> points;
 };
 
-void DrawPoints(LineToPointAdapter::Points::iterator begin, LineToPointAdapter::Points::iterator end)
+void DrawPoints(Points::const_iterator begin, Points::const_iterator end)
 {
     for (auto i = begin; i != end; ++i)
     {
@@ -152,7 +77,8 @@ int main()
     std::vector<Line> lines
     {
         Line{ Point{1, 1}, Point{1, 10} },
-        Line{ Point{3, 3}, Point{3, 10} }
+        Line{ Point{3, 3}, Point{3, 10} },
+        Line{ Point{0, 0}, Point{7, 3} }
     };
 
     for (auto& line : lines)
@@ -163,11 +89,18 @@ int main()
 
     std::cout << "Using caching adapter:" << std::endl;
 
-    for (auto& line : lines)
+    for (int pass = 0; pass < 2; ++pass)
     {
-        LineToPointCachingAdapter lpo{ line };
-        DrawPoints(lpo.begin(), lpo.end());
+        for (auto& line : lines)
+        {
+            LineToPointCachingAdapter lpo{ line };
+            DrawPoints(lpo.begin(), lpo.end());
+        }
     }
 
+    LineCacheStats stats = LineToPointCachingAdapter::cache.stats();
+    std::cout << "Cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.evictions << " evictions" << std::endl;
+
     return 0;
 }
\ No newline at end of file
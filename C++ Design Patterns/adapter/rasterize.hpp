@@ -0,0 +1,149 @@
+/**
+ * Integer line rasterization
+ *
+ * rasterize() appends the points of a line of any slope, from start to end, both
+ * included, exactly as Bresenham's algorithm picks them: one point per step along the
+ * major axis (the one the line spans more of), with the other coordinate rounded to the
+ * nearest integer, halves rounded toward the start.
+ *
+ * Short lines use the usual error-term loop. Its error is carried from one point to the
+ * next, and its branch on the error is taken in no predictable pattern. Long lines take
+ * a batch path instead: the i-th point is, in closed form,
+ *     minor offset = floor((2 * i * minor + major - 1) / (2 * major))
+ * so eight lanes start at points 0..7 with the exact quotient and remainder, and each run
+ * of eight moves every lane on by eight points at once: add a constant to the remainder
+ * and, where it wraps, one more minor step. That is the same additions, comparisons and
+ * masks in every lane, done on vectors of (x, y) pairs laid out as Points, so each run is
+ * stored straight into the buffer that rasterize() sized beforehand.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "geometry.hpp"
+
+typedef std::vector<Point> Points;
+
+namespace raster
+{
+    // lines of at least this many points take the batch path
+    inline constexpr int64_t batch_threshold = 64;
+    // and fewer than this many, so that the remainders of the batch path fit in 32 bits
+    inline constexpr int64_t batch_limit = int64_t{1} << 29;
+    // points computed side by side by the batch path
+    inline constexpr int lanes = 8;
+
+    // a and b are the coordinates along the major and the minor axis
+    template <bool XMajor>
+    inline void place(Point& point, int a, int b)
+    {
+        if constexpr (XMajor)
+            point = Point{a, b};
+        else
+            point = Point{b, a};
+    }
+
+    template <bool XMajor>
+    void step(int a, int b, int64_t major, int64_t minor, int a_step, int b_step, Point* out)
+    {
+        int64_t error = 2 * minor - major;
+        for (int64_t i = 0;; ++i)
+        {
+            place<XMajor>(out[i], a, b);
+            // stepping past the last point could overflow when the line ends at INT_MAX or INT_MIN
+            if (i == major)
+                break;
+            if (error > 0)
+            {
+                b += b_step;
+                error -= 2 * major;
+            }
+            error += 2 * minor;
+            a += a_step;
+        }
+    }
+
+    // Two points, as x, y, x, y. Plain GCC / Clang vector types: the compiler picks the
+    // instructions for the target (two SSE2 registers, one AVX2 register, NEON, ...).
+    typedef uint32_t Pair __attribute__((vector_size(16)));
+    typedef int32_t Remainders __attribute__((vector_size(16)));
+
+    template <bool XMajor>
+    void batch(int a, int b, int64_t major, int64_t minor, int a_step, int b_step, Point* out)
+    {
+        static_assert(sizeof(Point) == 2 * sizeof(int32_t), "points are stored as pairs of ints");
+        constexpr int pairs = lanes / 2;
+        constexpr int ai = XMajor ? 0 : 1, bi = 1 - ai;
+
+        // The minor offset of point i is floor(numerator / divisor), with
+        // numerator = 2 i minor + major - 1. Lane j holds point j of the current run of lanes,
+        // and the remainder of its division; moving to the next run adds advance to every
+        // numerator, so each lane steps like its own Bresenham loop.
+        const int32_t divisor = static_cast<int32_t>(2 * major);
+        const int64_t advance = 2 * minor * lanes;
+        const int32_t r_advance = static_cast<int32_t>(advance % divisor);
+        Pair points[pairs], step{}, carry_step{};
+        Remainders remainders[pairs];
+        step[ai] = step[ai + 2] = static_cast<uint32_t>(a_step * lanes);
+        step[bi] = step[bi + 2] = static_cast<uint32_t>(b_step * static_cast<int>(advance / divisor));
+        carry_step[bi] = carry_step[bi + 2] = static_cast<uint32_t>(b_step);
+        for (int j = 0; j < lanes; ++j)
+        {
+            int64_t numerator = 2 * minor * j + major - 1;
+            int k = 2 * (j % 2);
+            points[j / 2][k + ai] = static_cast<uint32_t>(a + a_step * j);
+            points[j / 2][k + bi] = static_cast<uint32_t>(b + b_step * static_cast<int>(numerator / divisor));
+            remainders[j / 2][k] = remainders[j / 2][k + 1] = static_cast<int32_t>(numerator % divisor);
+        }
+
+        // the coordinates are unsigned so that the lanes may step past the end of the line
+        int64_t n = major + 1, i = 0;
+        for (; i + lanes <= n; i += lanes)
+        {
+            std::memcpy(out + i, points, sizeof points);
+            for (int v = 0; v < pairs; ++v)
+            {
+                remainders[v] += r_advance;
+                // all ones where the remainder wrapped, and the minor coordinate moves one more step
+                Remainders carry = remainders[v] >= divisor;
+                remainders[v] -= divisor & carry;
+                points[v] += step + (carry_step & __builtin_convertvector(carry, Pair));
+            }
+        }
+        std::memcpy(out + i, points, static_cast<size_t>(n - i) * sizeof(Point));
+    }
+}
+
+inline void rasterize(const Line& line, Points& points)
+{
+    int64_t dx = int64_t{line.end.x} - line.start.x;
+    int64_t dy = int64_t{line.end.y} - line.start.y;
+    int x_step = dx < 0 ? -1 : 1;
+    int y_step = dy < 0 ? -1 : 1;
+    dx = dx < 0 ? -dx : dx;
+    dy = dy < 0 ? -dy : dy;
+
+    size_t first = points.size();
+    points.resize(first + static_cast<size_t>(std::max(dx, dy)) + 1);
+    Point* out = points.data() + first;
+
+    if (dx >= dy)
+    {
+        if (dx + 1 >= raster::batch_threshold && dx < raster::batch_limit)
+            raster::batch<true>(line.start.x, line.start.y, dx, dy, x_step, y_step, out);
+        else
+            raster::step<true>(line.start.x, line.start.y, dx, dy, x_step, y_step, out);
+    }
+    else
+    {
+        if (dy + 1 >= raster::batch_threshold && dy < raster::batch_limit)
+            raster::batch<false>(line.start.y, line.start.x, dy, dx, y_step, x_step, out);
+        else
+            raster::step<false>(line.start.y, line.start.x, dy, dx, y_step, x_step, out);
+    }
+}
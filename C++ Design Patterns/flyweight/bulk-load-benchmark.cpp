@@ -0,0 +1,129 @@
+/*
+ * Benchmark of the parallel bulk loader against creating users one at a time
+ *
+ * A CSV file of random first/last name pairs is written to a temporary file, then loaded
+ * twice: row by row with std::getline into a vector of User (the old load path), and
+ * with load_users(). Both must produce the same names in the same order.
+ * Usage: bulk-load-benchmark [rows] [distinct names] [threads]
+ */
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bulk-loader.hpp"
+
+// A unique path in the temporary directory, removed with whatever was written there
+// when it goes out of scope, on every way out of main.
+class TemporaryFile
+{
+public:
+    explicit TemporaryFile(const std::string& prefix)
+    {
+        std::random_device seed;
+        file = std::filesystem::temp_directory_path()
+                / (prefix + "-" + std::to_string(seed()) + std::to_string(seed()) + ".csv");
+    }
+
+    ~TemporaryFile()
+    {
+        std::error_code ignored;
+        std::filesystem::remove(file, ignored);
+    }
+
+    TemporaryFile(TemporaryFile const&) = delete;
+    void operator=(TemporaryFile const&) = delete;
+
+    std::string path() const { return file.string(); }
+
+private:
+    std::filesystem::path file;
+};
+
+void write_names(const std::string& path, size_t rows, size_t distinct)
+{
+    std::mt19937 rng{42};
+    std::vector<std::string> names;
+    for (size_t i = 0; i < distinct; ++i)
+        names.push_back("name" + std::to_string(rng() % 1000000) + "_" + std::to_string(i));
+
+    std::ofstream out(path, std::ios::trunc);
+    for (size_t i = 0; i < rows; ++i)
+        out << names[rng() % distinct] << ',' << names[rng() % distinct] << '\n';
+    if (!out)
+        throw std::runtime_error("cannot write " + path);
+}
+
+template <typename F>
+double measure(const char* name, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << name << ": " << elapsed.count() << " ms" << std::endl;
+    return elapsed.count();
+}
+
+int run(int argc, char* argv[])
+{
+    size_t rows = argc > 1 ? std::stoul(argv[1]) : 2000000;
+    size_t distinct = argc > 2 ? std::stoul(argv[2]) : 50000;
+    unsigned threads = argc > 3 ? static_cast<unsigned>(std::stoul(argv[3])) : std::thread::hardware_concurrency();
+
+    TemporaryFile csv{"bulk-load-benchmark"};
+    const std::string path = csv.path();
+    write_names(path, rows, distinct);
+    std::cout << rows << " rows, " << distinct << " distinct names, " << threads << " threads" << std::endl;
+
+    std::vector<User> users;
+    double one_by_one = measure("User one at a time", [&]
+    {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            size_t comma = line.find(',');
+            users.emplace_back(line.substr(0, comma), line.substr(comma + 1));
+        }
+    });
+
+    UserTable table;
+    double bulk = measure("load_users         ", [&] { table = load_users(path, threads); });
+
+    if (table.size() != users.size())
+    {
+        std::cerr << "row counts differ" << std::endl;
+        return 1;
+    }
+    for (size_t i = 0; i < users.size(); ++i)
+    {
+        if (table.first_name(i) != users[i].get_first_name() || table.last_name(i) != users[i].get_last_name())
+        {
+            std::cerr << "row " << i << " differs" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "speedup: " << one_by_one / bulk << "x, "
+              << sizeof(UserRecord) << " bytes per record" << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    // caught here rather than left to terminate(), so that the temporary file is removed
+    try
+    {
+        return run(argc, argv);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,251 @@
+/*
+ * Parallel bulk loading of users
+ *
+ * Creating users one at a time from a big file interns every name once per row, and
+ * every one of those calls goes to the shared interner. load_users() does the work in
+ * three parallel steps instead:
+ *  1. the file is mapped and split into one chunk per thread on line boundaries;
+ *  2. each thread parses its chunk without copying anything and deduplicates names
+ *     in a table of its own, recording each row as a pair of local ids;
+ *  3. each thread interns its distinct names into the shared table once, then
+ *     rewrites its rows with the shared keys.
+ * The shared interner therefore only sees each name once per thread.
+ *
+ * The result is a UserTable: an array of 8-byte records holding only the two keys.
+ * The table holds one reference to every name it uses and releases them when destroyed.
+ * The file has one "first,last" row per line; fields are not quoted and empty lines are skipped.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "user.hpp"
+
+struct UserRecord
+{
+    key first_name, last_name;
+};
+
+class UserTable
+{
+public:
+    UserTable() = default;
+    UserTable(UserTable const&) = delete;
+    void operator=(UserTable const&) = delete;
+
+    UserTable(UserTable&& other) noexcept
+        : records{std::move(other.records)}, held{std::move(other.held)} {}
+
+    UserTable& operator=(UserTable&& other) noexcept
+    {
+        records.swap(other.records);
+        held.swap(other.held);
+        return *this;
+    }
+
+    ~UserTable()
+    {
+        for (key k : held)
+            User::release_name(k);
+    }
+
+    size_t size() const { return records.size(); }
+    const UserRecord& operator[](size_t i) const { return records[i]; }
+
+    std::string_view first_name(size_t i) const { return User::name(records[i].first_name); }
+    std::string_view last_name(size_t i) const { return User::name(records[i].last_name); }
+
+    // Creates a full User for one row.
+    User user(size_t i) const
+    {
+        return User{std::string{first_name(i)}, std::string{last_name(i)}};
+    }
+
+private:
+    friend UserTable load_users(const std::string& path, unsigned threads);
+
+    std::vector<UserRecord> records;
+    // one reference per distinct name and loading thread
+    std::vector<key> held;
+};
+
+namespace detail
+{
+    class MappedCsv
+    {
+    public:
+        explicit MappedCsv(const std::string& path)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("cannot open " + path);
+            struct stat info{};
+            if (::fstat(fd, &info) == 0 && info.st_size > 0)
+            {
+                length = static_cast<size_t>(info.st_size);
+                void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped == MAP_FAILED)
+                {
+                    ::close(fd);
+                    throw std::runtime_error("cannot map " + path);
+                }
+                address = static_cast<const char*>(mapped);
+                ::madvise(mapped, length, MADV_SEQUENTIAL);
+            }
+            ::close(fd);
+        }
+
+        ~MappedCsv()
+        {
+            if (address)
+                ::munmap(const_cast<char*>(address), length);
+        }
+
+        MappedCsv(MappedCsv const&) = delete;
+        void operator=(MappedCsv const&) = delete;
+
+        std::string_view view() const { return {address, length}; }
+
+    private:
+        const char* address = nullptr;
+        size_t length = 0;
+    };
+
+    // The rows of one chunk, as ids into the chunk's own table of distinct names.
+    struct LocalNames
+    {
+        std::unordered_map<std::string_view, uint32_t> ids;
+        std::vector<std::string_view> names;
+        std::vector<UserRecord> rows;
+
+        uint32_t add(std::string_view name)
+        {
+            auto [it, inserted] = ids.try_emplace(name, static_cast<uint32_t>(names.size()));
+            if (inserted)
+                names.push_back(name);
+            return it->second;
+        }
+
+        void parse(std::string_view chunk)
+        {
+            while (!chunk.empty())
+            {
+                size_t end = chunk.find('\n');
+                std::string_view line = chunk.substr(0, end);
+                chunk.remove_prefix(end == std::string_view::npos ? chunk.size() : end + 1);
+                if (!line.empty() && line.back() == '\r')
+                    line.remove_suffix(1);
+                if (line.empty())
+                    continue;
+
+                size_t comma = line.find(',');
+                if (comma == std::string_view::npos)
+                    throw std::runtime_error("malformed user row: " + std::string{line});
+                rows.push_back({add(line.substr(0, comma)), add(line.substr(comma + 1))});
+            }
+        }
+    };
+
+    // Splits text into count pieces that each end right after a newline (or at the end).
+    inline std::vector<std::string_view> split_lines(std::string_view text, unsigned count)
+    {
+        std::vector<std::string_view> chunks;
+        size_t begin = 0;
+        for (unsigned i = 1; i <= count && begin < text.size(); ++i)
+        {
+            size_t end = text.size() * i / count;
+            if (end < begin)
+                end = begin;
+            end = i == count ? text.size() : text.find('\n', end);
+            end = end == std::string_view::npos ? text.size() : std::min(end + 1, text.size());
+            chunks.push_back(text.substr(begin, end - begin));
+            begin = end;
+        }
+        return chunks;
+    }
+}
+
+inline UserTable load_users(const std::string& path, unsigned threads = std::thread::hardware_concurrency())
+{
+    if (threads == 0)
+        threads = 1;
+    detail::MappedCsv file{path};
+    std::vector<std::string_view> chunks = detail::split_lines(file.view(), threads);
+    std::vector<detail::LocalNames> locals(chunks.size());
+    std::vector<std::vector<key>> shared(chunks.size());
+    std::vector<size_t> offsets(chunks.size() + 1, 0);
+    UserTable table;
+
+    // runs step(i) for every chunk, one thread each, and rethrows the first error
+    auto in_parallel = [&](auto&& step)
+    {
+        std::vector<std::exception_ptr> errors(chunks.size());
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < chunks.size(); ++i)
+            workers.emplace_back([&, i]
+            {
+                try
+                {
+                    step(i);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            });
+        for (auto& worker : workers)
+            worker.join();
+        for (auto& error : errors)
+            if (error)
+                std::rethrow_exception(error);
+    };
+
+    in_parallel([&](size_t i)
+    {
+        locals[i].parse(chunks[i]);
+    });
+
+    for (size_t i = 0; i < chunks.size(); ++i)
+        offsets[i + 1] = offsets[i] + locals[i].rows.size();
+    table.records.resize(offsets.back());
+
+    try
+    {
+        in_parallel([&](size_t i)
+        {
+            const detail::LocalNames& local = locals[i];
+            shared[i].reserve(local.names.size());
+            for (std::string_view name : local.names)
+                shared[i].push_back(User::acquire_name(name));
+            UserRecord* out = table.records.data() + offsets[i];
+            for (const UserRecord& row : local.rows)
+                *out++ = {shared[i][row.first_name], shared[i][row.last_name]};
+        });
+    }
+    catch (...)
+    {
+        for (auto& keys : shared)
+            for (key k : keys)
+                User::release_name(k);
+        throw;
+    }
+
+    for (auto& keys : shared)
+        table.held.insert(table.held.end(), keys.begin(), keys.end());
+    return table;
+}
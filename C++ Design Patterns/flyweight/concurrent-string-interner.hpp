@@ -0,0 +1,403 @@
+/*
+ * Concurrent string interner
+ *
+ * A thread-safe version of StringInterner, so that User objects can be created
+ * from many threads that all share one table of names.
+ * The names are split into shards by hash. Each shard has its own open-addressing
+ * hash table and its own append-only array of names:
+ *  - looking up a name that is already interned takes no lock at all: the table and
+ *    the names are only ever published with release stores and read with acquire loads;
+ *  - adding a name locks only the shard it belongs to, and checks the table again
+ *    under the lock in case another thread added the same name in the meantime.
+ * A key is (index within shard << shard bits) | shard, so keys never change and
+ * get() is a lock-free O(1) lookup. That leaves 26 bits for the index: a shard that
+ * would need more throws std::length_error instead of handing out colliding keys.
+ * Each shard stores its characters in its own StringArena, written under the shard lock.
+ * When a shard's table grows, the old table is kept until the interner is destroyed,
+ * because a reader may still be probing it; the tables retired this way add up to
+ * less than the size of the current one.
+ *
+ * Reference counting
+ * intern() pins a name for the lifetime of the interner. Names obtained through acquire()
+ * are reference counted instead: retain() and release() only touch the entry's counter,
+ * and a name whose count drops to zero becomes a reclamation candidate. Candidates are
+ * reclaimed in batches (automatically once enough of them pile up, or by calling collect()):
+ * they are marked dead and unlinked from the hash table, then the shard waits for the end
+ * of the current read epoch, so that no lock-free lookup can still be looking at them,
+ * and only then are their keys and arena bytes put on free lists for reuse.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "segmented-array.hpp"
+#include "string-interner.hpp"
+
+class ConcurrentStringInterner
+{
+public:
+    ConcurrentStringInterner() = default;
+    ConcurrentStringInterner(ConcurrentStringInterner const&) = delete;
+    void operator=(ConcurrentStringInterner const&) = delete;
+
+    // Returns the key of s; the name is never reclaimed.
+    key intern(std::string_view s)
+    {
+        return lookup(s, pinned);
+    }
+
+    // Returns the key of s holding one reference to it, to be given back with release().
+    key acquire(std::string_view s)
+    {
+        return lookup(s, 1);
+    }
+
+    // Adds a reference to a key already held through acquire().
+    void retain(key k)
+    {
+        shard_of(k).references[k >> shard_bits].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release(key k)
+    {
+        Shard& shard = shard_of(k);
+        uint32_t previous = shard.references[k >> shard_bits].fetch_sub(1, std::memory_order_acq_rel);
+        if (previous != 1)
+            return;
+
+        // last reference gone: queue the entry, and reclaim once a batch is ready
+        size_t pending;
+        {
+            std::lock_guard<std::mutex> lock{shard.candidates_mutex};
+            shard.candidates.push_back(static_cast<uint32_t>(k >> shard_bits));
+            pending = shard.candidates.size();
+        }
+        if (pending >= reclaim_batch)
+        {
+            std::unique_lock<std::mutex> lock{shard.mutex, std::try_to_lock};
+            if (lock.owns_lock())
+                reclaim(shard);
+        }
+    }
+
+    // Reclaims every entry whose last reference has been released.
+    void collect()
+    {
+        for (auto& shard : shards)
+        {
+            std::lock_guard<std::mutex> lock{shard.mutex};
+            reclaim(shard);
+        }
+    }
+
+    std::string_view get(key k) const
+    {
+        const Shard& shard = shard_of(k);
+        return shard.arena.get(shard.names[k >> shard_bits]);
+    }
+
+    // number of live names
+    size_t size() const
+    {
+        size_t total = 0;
+        for (auto& shard : shards)
+            total += shard.live.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    // Calls f(key, name) for every live name; must not run concurrently with collect().
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        for (uint64_t s = 0; s <= shard_mask; ++s)
+        {
+            const Shard& shard = shards[s];
+            size_t count = shard.names.size();
+            for (size_t index = 0; index < count; ++index)
+                if (!(shard.references[index].load(std::memory_order_acquire) & dead))
+                    f(make_key(s, index), shard.arena.get(shard.names[index]));
+        }
+    }
+
+    // Locks each shard in turn, so the totals are exact only when nobody is interning.
+    InternerStats stats()
+    {
+        InternerStats result;
+        for (auto& shard : shards)
+        {
+            std::lock_guard<std::mutex> lock{shard.mutex};
+            result.distinct_strings += shard.live.load(std::memory_order_relaxed);
+            result.intern_calls += shard.calls.load(std::memory_order_relaxed);
+            result.payload_bytes += shard.arena.payload_bytes();
+            result.bytes_used += shard.arena.reserved_bytes()
+                + shard.names.size() * (sizeof(StringRef) + sizeof(uint32_t));
+            for (auto& table : shard.tables)
+                result.bytes_used += (table->mask + 1) * sizeof(uint64_t);
+        }
+        return result;
+    }
+
+private:
+    static constexpr unsigned shard_bits = 6;
+    static constexpr uint64_t shard_mask = (1u << shard_bits) - 1;
+    static constexpr size_t reclaim_batch = 1024;
+    // largest index within a shard that still fits in a key next to the shard bits
+    static constexpr size_t max_index = (size_t{1} << (32 - shard_bits)) - 1;
+
+    // reference count flags: pinned entries are never reclaimed, dead ones are being reclaimed
+    static constexpr uint32_t pinned = 1u << 30;
+    static constexpr uint32_t dead = 1u << 31;
+
+    // A slot holds the upper 32 bits of the name's hash and its index + 1, 0 means empty.
+    static constexpr uint64_t tombstone = UINT64_MAX;
+
+    struct Table
+    {
+        explicit Table(size_t capacity)
+            : mask(capacity - 1), slots(new std::atomic<uint64_t>[capacity])
+        {
+            for (size_t i = 0; i < capacity; ++i)
+                slots[i].store(0, std::memory_order_relaxed);
+        }
+
+        size_t mask;
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;
+    };
+
+    struct Shard
+    {
+        Shard()
+        {
+            tables.push_back(std::make_unique<Table>(16));
+            table.store(tables.back().get(), std::memory_order_relaxed);
+        }
+
+        std::mutex mutex;
+        std::atomic<Table*> table;
+        StringArena arena;
+        SegmentedArray<StringRef> names;
+        SegmentedArray<std::atomic<uint32_t>> references;
+        std::atomic<size_t> calls{0};
+        std::atomic<size_t> live{0};
+        // occupied table slots, tombstones included
+        size_t used_slots = 0;
+        // the current table and every table it replaced
+        std::vector<std::unique_ptr<Table>> tables;
+
+        // lock-free lookups in progress, per epoch parity
+        std::atomic<unsigned> epoch{0};
+        std::atomic<uint32_t> readers[2] = {};
+
+        std::mutex candidates_mutex;
+        std::vector<uint32_t> candidates;
+        // indices of reclaimed entries, ready for reuse
+        std::vector<uint32_t> free_indices;
+    };
+
+    static key make_key(uint64_t shard, size_t index)
+    {
+        return static_cast<key>((index << shard_bits) | shard);
+    }
+
+    Shard& shard_of(key k) { return shards[k & shard_mask]; }
+    const Shard& shard_of(key k) const { return shards[k & shard_mask]; }
+
+    // Finds s, inserting it if needed, and adds a reference (pinned or 1) to it.
+    key lookup(std::string_view s, uint32_t reference)
+    {
+        uint64_t hash = hash_name(s);
+        uint64_t shard_index = hash & shard_mask;
+        Shard& shard = shards[shard_index];
+        uint32_t tag = static_cast<uint32_t>(hash >> 32);
+        shard.calls.fetch_add(1, std::memory_order_relaxed);
+
+        size_t index;
+        {
+            unsigned epoch = enter(shard);
+            bool found = find(shard, s, tag, index) && add_reference(shard, index, reference);
+            leave(shard, epoch);
+            if (found)
+                return make_key(shard_index, index);
+        }
+
+        std::lock_guard<std::mutex> lock{shard.mutex};
+        // entries are only marked dead under this lock, so a hit here is live
+        if (find(shard, s, tag, index) && add_reference(shard, index, reference))
+            return make_key(shard_index, index);
+
+        if (shard.free_indices.empty() && shard.names.size() > max_index)
+            throw std::length_error("too many names in one shard for 32-bit keys");
+        StringRef ref = shard.arena.store(s);
+        if (!shard.free_indices.empty())
+        {
+            index = shard.free_indices.back();
+            shard.free_indices.pop_back();
+            shard.names[index] = ref;
+            shard.references[index].store(reference, std::memory_order_relaxed);
+        }
+        else
+        {
+            index = shard.names.emplace_back(ref);
+            shard.references.emplace_back(reference);
+        }
+        insert(shard, tag, index);
+        shard.live.fetch_add(1, std::memory_order_relaxed);
+        return make_key(shard_index, index);
+    }
+
+    static bool add_reference(Shard& shard, size_t index, uint32_t reference)
+    {
+        auto& count = shard.references[index];
+        uint32_t current = count.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            if (current & dead)
+                return false;
+            uint32_t next = reference == pinned ? current | pinned : current + 1;
+            if (count.compare_exchange_weak(current, next, std::memory_order_acq_rel))
+                return true;
+        }
+    }
+
+    static unsigned enter(Shard& shard)
+    {
+        for (;;)
+        {
+            unsigned epoch = shard.epoch.load();
+            shard.readers[epoch].fetch_add(1);
+            if (shard.epoch.load() == epoch)
+                return epoch;
+            shard.readers[epoch].fetch_sub(1);
+        }
+    }
+
+    static void leave(Shard& shard, unsigned epoch)
+    {
+        shard.readers[epoch].fetch_sub(1);
+    }
+
+    static bool find(const Shard& shard, std::string_view s, uint32_t tag, size_t& index)
+    {
+        const Table* table = shard.table.load(std::memory_order_acquire);
+        for (size_t i = tag & table->mask;; i = (i + 1) & table->mask)
+        {
+            uint64_t slot = table->slots[i].load(std::memory_order_acquire);
+            if (slot == 0)
+                return false;
+            if (slot == tombstone || static_cast<uint32_t>(slot >> 32) != tag)
+                continue;
+            size_t candidate = static_cast<uint32_t>(slot) - 1;
+            if (shard.arena.get(shard.names[candidate]) == s)
+            {
+                index = candidate;
+                return true;
+            }
+        }
+    }
+
+    // Called with the shard locked, after the name has been stored at index.
+    void insert(Shard& shard, uint32_t tag, size_t index)
+    {
+        Table* table = shard.table.load(std::memory_order_relaxed);
+        uint64_t slot = (uint64_t{tag} << 32) | (index + 1);
+        if ((shard.used_slots + 1) * 2 > table->mask + 1)
+        {
+            // rebuild without tombstones, doubling only if the live entries need it
+            size_t live = shard.live.load(std::memory_order_relaxed) + 1;
+            size_t capacity = table->mask + 1;
+            if (live * 4 > capacity)
+                capacity *= 2;
+            auto rebuilt = std::make_unique<Table>(capacity);
+            shard.used_slots = 0;
+            for (size_t i = 0; i <= table->mask; ++i)
+            {
+                uint64_t old = table->slots[i].load(std::memory_order_relaxed);
+                if (old != 0 && old != tombstone)
+                {
+                    place(*rebuilt, old);
+                    ++shard.used_slots;
+                }
+            }
+            place(*rebuilt, slot);
+            ++shard.used_slots;
+            shard.table.store(rebuilt.get(), std::memory_order_release);
+            shard.tables.push_back(std::move(rebuilt));
+            return;
+        }
+        if (place(*table, slot) == 0)
+            ++shard.used_slots;
+    }
+
+    // Stores slot in the first empty or tombstoned position and returns what was there.
+    static uint64_t place(Table& table, uint64_t slot)
+    {
+        for (size_t i = static_cast<uint32_t>(slot >> 32) & table.mask;; i = (i + 1) & table.mask)
+        {
+            uint64_t old = table.slots[i].load(std::memory_order_relaxed);
+            if (old == 0 || old == tombstone)
+            {
+                table.slots[i].store(slot, std::memory_order_release);
+                return old;
+            }
+        }
+    }
+
+    // Called with the shard locked.
+    void reclaim(Shard& shard)
+    {
+        std::vector<uint32_t> batch;
+        {
+            std::lock_guard<std::mutex> lock{shard.candidates_mutex};
+            batch.swap(shard.candidates);
+        }
+
+        std::vector<uint32_t> unlinked;
+        Table* table = shard.table.load(std::memory_order_relaxed);
+        for (uint32_t index : batch)
+        {
+            // a candidate may have been acquired again, or queued twice
+            uint32_t expected = 0;
+            if (!shard.references[index].compare_exchange_strong(expected, dead))
+                continue;
+
+            uint32_t tag = static_cast<uint32_t>(hash_name(shard.arena.get(shard.names[index])) >> 32);
+            uint64_t slot = (uint64_t{tag} << 32) | (index + 1);
+            for (size_t i = tag & table->mask;; i = (i + 1) & table->mask)
+            {
+                if (table->slots[i].load(std::memory_order_relaxed) == slot)
+                {
+                    table->slots[i].store(tombstone, std::memory_order_release);
+                    break;
+                }
+            }
+            unlinked.push_back(index);
+        }
+        if (unlinked.empty())
+            return;
+
+        // Lookups that started before the unlinking may still be comparing against
+        // these names. Switch epochs and wait until every lookup of the old epoch is done.
+        unsigned old_epoch = shard.epoch.load();
+        shard.epoch.store(old_epoch ^ 1);
+        while (shard.readers[old_epoch].load() != 0)
+            std::this_thread::yield();
+
+        for (uint32_t index : unlinked)
+        {
+            shard.arena.release(shard.names[index]);
+            shard.free_indices.push_back(index);
+        }
+        shard.live.fetch_sub(unlinked.size(), std::memory_order_relaxed);
+    }
+
+    Shard shards[shard_mask + 1];
+};
@@ -0,0 +1,237 @@
+/*
+ * Generic flyweight
+ *
+ * Flyweight<T> is a 4-byte handle to an immutable value of type T that is stored once
+ * no matter how many handles refer to it, so any high-cardinality field (addresses, tags,
+ * colors, ...) gets the same savings as User's names. Dereferencing a handle is an index
+ * into an array, and two handles are equal exactly when their values are equal, so
+ * comparing them never looks at the values.
+ *
+ * Each instantiation keeps its values in a static Storage, chosen by policy:
+ *  - SingleThreadedStorage: an open-addressing hash table of keys, like StringInterner;
+ *  - ThreadSafeStorage: the same table split into shards with a mutex each; dereferencing
+ *    takes no lock, because values live in SegmentedArrays and never move.
+ * Hash and Eq work as in std::unordered_set. Values are never removed, and a value that
+ * would need a key beyond 32 bits (past 2^28 values in one shard of ThreadSafeStorage)
+ * is refused with std::length_error.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include "segmented-array.hpp"
+#include "string-interner.hpp"
+
+namespace detail
+{
+    // std::hash is the identity for integers; spread the bits before using them as a slot
+    inline uint64_t mix_hash(uint64_t hash)
+    {
+        hash ^= hash >> 32;
+        hash *= 0xd6e8feb86659fd93ull;
+        hash ^= hash >> 32;
+        return hash;
+    }
+}
+
+template <typename T, typename Hash, typename Eq>
+class SingleThreadedStorage
+{
+public:
+    SingleThreadedStorage()
+        : slots(16, empty) {}
+
+    SingleThreadedStorage(SingleThreadedStorage const&) = delete;
+    void operator=(SingleThreadedStorage const&) = delete;
+
+    key intern(const T& value)
+    {
+        uint64_t hash = detail::mix_hash(Hash{}(value));
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            key k = slots[i];
+            if (k == empty)
+                break;
+            if (hashes[k] == hash && Eq{}(values[k], value))
+                return k;
+        }
+
+        // the last key is the empty slot marker
+        if (values.size() >= empty)
+            throw std::length_error("too many values for 32-bit keys");
+        key k = static_cast<key>(values.emplace_back(value));
+        hashes.push_back(hash);
+        if (hashes.size() * 2 > slots.size())
+            rehash(slots.size() * 2);
+        else
+            place(k);
+        return k;
+    }
+
+    const T& get(key k) const { return values[k]; }
+
+    size_t size() const { return values.size(); }
+
+private:
+    static constexpr key empty = UINT32_MAX;
+
+    void place(key k)
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = hashes[k] & mask;
+        while (slots[i] != empty)
+            i = (i + 1) & mask;
+        slots[i] = k;
+    }
+
+    void rehash(size_t capacity)
+    {
+        slots.assign(capacity, empty);
+        for (key k = 0; k < hashes.size(); ++k)
+            place(k);
+    }
+
+    SegmentedArray<T> values;
+    std::vector<uint64_t> hashes;
+    std::vector<key> slots;
+};
+
+template <typename T, typename Hash, typename Eq>
+class ThreadSafeStorage
+{
+public:
+    ThreadSafeStorage() = default;
+    ThreadSafeStorage(ThreadSafeStorage const&) = delete;
+    void operator=(ThreadSafeStorage const&) = delete;
+
+    key intern(const T& value)
+    {
+        // the low bits pick the shard, the shard's table uses the high ones
+        uint64_t hash = detail::mix_hash(Hash{}(value));
+        uint64_t shard_index = hash & shard_mask;
+        Shard& shard = shards[shard_index];
+        uint64_t tag = hash >> shard_bits;
+
+        std::lock_guard<std::mutex> lock{shard.mutex};
+        size_t mask = shard.slots.size() - 1;
+        for (size_t i = tag & mask;; i = (i + 1) & mask)
+        {
+            uint32_t index = shard.slots[i];
+            if (index == empty)
+                break;
+            if (shard.hashes[index] == tag && Eq{}(shard.values[index], value))
+                return make_key(shard_index, index);
+        }
+
+        if (shard.values.size() > max_index)
+            throw std::length_error("too many values in one shard for 32-bit keys");
+        size_t index = shard.values.emplace_back(value);
+        shard.hashes.push_back(tag);
+        if (shard.hashes.size() * 2 > shard.slots.size())
+            rehash(shard, shard.slots.size() * 2);
+        else
+            place(shard, static_cast<uint32_t>(index));
+        return make_key(shard_index, index);
+    }
+
+    // Lock-free: the key was returned by intern(), which published the value.
+    const T& get(key k) const
+    {
+        return shards[k & shard_mask].values[k >> shard_bits];
+    }
+
+    size_t size() const
+    {
+        size_t total = 0;
+        for (auto& shard : shards)
+            total += shard.values.size();
+        return total;
+    }
+
+private:
+    static constexpr unsigned shard_bits = 4;
+    static constexpr uint64_t shard_mask = (1u << shard_bits) - 1;
+    // largest index within a shard that still fits in a key next to the shard bits
+    static constexpr size_t max_index = (size_t{1} << (32 - shard_bits)) - 1;
+    static constexpr uint32_t empty = UINT32_MAX;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        SegmentedArray<T> values;
+        std::vector<uint64_t> hashes;
+        std::vector<uint32_t> slots = std::vector<uint32_t>(16, empty);
+    };
+
+    static key make_key(uint64_t shard, size_t index)
+    {
+        return static_cast<key>((index << shard_bits) | shard);
+    }
+
+    static void place(Shard& shard, uint32_t index)
+    {
+        size_t mask = shard.slots.size() - 1;
+        size_t i = shard.hashes[index] & mask;
+        while (shard.slots[i] != empty)
+            i = (i + 1) & mask;
+        shard.slots[i] = index;
+    }
+
+    static void rehash(Shard& shard, size_t capacity)
+    {
+        shard.slots.assign(capacity, empty);
+        for (uint32_t index = 0; index < shard.hashes.size(); ++index)
+            place(shard, index);
+    }
+
+    Shard shards[shard_mask + 1];
+};
+
+template <typename T,
+          typename Hash = std::hash<T>,
+          typename Eq = std::equal_to<T>,
+          template <typename, typename, typename> class Storage = SingleThreadedStorage>
+class Flyweight
+{
+public:
+    typedef Storage<T, Hash, Eq> storage_type;
+
+    Flyweight()
+        : id{storage.intern(T{})} {}
+
+    Flyweight(const T& value)
+        : id{storage.intern(value)} {}
+
+    const T& get() const { return storage.get(id); }
+    operator const T&() const { return get(); }
+    const T& operator*() const { return get(); }
+    const T* operator->() const { return &get(); }
+
+    key handle() const { return id; }
+
+    // number of distinct values of this instantiation
+    static size_t distinct() { return storage.size(); }
+
+    friend bool operator==(Flyweight a, Flyweight b) { return a.id == b.id; }
+    friend bool operator!=(Flyweight a, Flyweight b) { return a.id != b.id; }
+
+private:
+    key id;
+    inline static storage_type storage;
+};
+
+namespace std
+{
+    template <typename T, typename Hash, typename Eq, template <typename, typename, typename> class Storage>
+    struct hash<Flyweight<T, Hash, Eq, Storage>>
+    {
+        size_t operator()(Flyweight<T, Hash, Eq, Storage> f) const noexcept { return f.handle(); }
+    };
+}
@@ -0,0 +1,118 @@
+/*
+ * Concurrent stress test of ConcurrentStringInterner
+ *
+ * Several threads intern, acquire, retain and release names drawn from one shared pool,
+ * so that the same names are inserted, looked up and reclaimed by different threads at
+ * the same time, while collect() runs now and then. Every key handed out must map back
+ * to its name for as long as it is held, and once everything is released and collected
+ * only the pinned names may be left.
+ * Meant to be run under ThreadSanitizer as well:
+ *     g++ -std=c++17 -O1 -g -fsanitize=thread -pthread interner-stress.cpp
+ * Usage: interner-stress [threads] [operations per thread] [distinct names]
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "concurrent-string-interner.hpp"
+
+int main(int argc, char* argv[])
+{
+    size_t threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 8;
+    size_t operations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 200000;
+    size_t distinct = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 5000;
+
+    std::vector<std::string> pool;
+    for (size_t i = 0; i < distinct; ++i)
+        pool.push_back("name_" + std::to_string(i * 7919 % 100003));
+
+    ConcurrentStringInterner interner;
+    std::atomic<size_t> failures{0};
+    std::mutex pinned_mutex;
+    std::set<std::string> pinned;
+
+    auto check = [&](key k, const std::string& name)
+    {
+        if (interner.get(k) != name)
+            failures.fetch_add(1, std::memory_order_relaxed);
+    };
+
+    auto worker = [&](unsigned seed)
+    {
+        std::mt19937 rng{seed};
+        // keys this thread holds a reference to, with their name
+        std::vector<std::pair<key, const std::string*>> held;
+        std::set<std::string> pinned_here;
+        for (size_t i = 0; i < operations; ++i)
+        {
+            const std::string& name = pool[rng() % pool.size()];
+            unsigned op = rng() % 100;
+            if (op < 2)
+            {
+                key k = interner.intern(name);
+                check(k, name);
+                pinned_here.insert(name);
+            }
+            else if (op < 45)
+            {
+                key k = interner.acquire(name);
+                check(k, name);
+                held.emplace_back(k, &name);
+            }
+            else if (op < 50 && !held.empty())
+            {
+                auto& entry = held[rng() % held.size()];
+                interner.retain(entry.first);
+                held.push_back(entry);
+            }
+            else if (op < 99 && !held.empty())
+            {
+                size_t at = rng() % held.size();
+                check(held[at].first, *held[at].second);
+                interner.release(held[at].first);
+                held[at] = held.back();
+                held.pop_back();
+            }
+            else if (op == 99)
+            {
+                interner.collect();
+            }
+        }
+        for (auto& [k, name] : held)
+        {
+            check(k, *name);
+            interner.release(k);
+        }
+        std::lock_guard<std::mutex> lock{pinned_mutex};
+        pinned.insert(pinned_here.begin(), pinned_here.end());
+    };
+
+    std::vector<std::thread> pool_threads;
+    for (size_t t = 0; t < threads; ++t)
+        pool_threads.emplace_back(worker, static_cast<unsigned>(t + 1));
+    for (auto& thread : pool_threads)
+        thread.join();
+
+    interner.collect();
+    size_t left = 0;
+    interner.for_each([&](key k, std::string_view name)
+    {
+        ++left;
+        if (!pinned.count(std::string{name}) || interner.get(k) != name)
+            failures.fetch_add(1, std::memory_order_relaxed);
+    });
+    if (left != pinned.size() || interner.size() != pinned.size())
+        failures.fetch_add(1, std::memory_order_relaxed);
+
+    std::cout << threads << " threads, " << operations << " operations each: " << left << " pinned names left, "
+              << failures.load() << " failures" << std::endl;
+    return failures.load() == 0 ? 0 : 1;
+}
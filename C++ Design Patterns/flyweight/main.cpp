@@ -10,52 +10,10 @@
  */
 
 #include <cstdint>
-#include <map>
 #include <iostream>
 #include <sstream>
-
-typedef uint32_t key;
-
-struct User
-{
-    User(const std::string& first_name, const std::string& last_name)
-        : first_name{add(first_name)}, last_name{add(last_name)} {}
-
-    const std::string& get_first_name() const
-    {
-        return names.find(first_name)->second;
-    }
-
-    const std::string& get_last_name() const
-    {
-        return names.find(last_name)->second;
-    }
-
-protected:
-    key first_name, last_name;
-    static std::map<key, std::string> names;
-    static key seed;
-
-    static key add(const std::string& s)
-    {
-        auto it = std::find_if(names.begin(), names.end(), [&s](const auto& pair) { return pair.second == s; });
-        if (it == names.end())
-        {
-            key id = ++seed;
-            names.insert({id, s});
-            return id;
-        }
-        return it->first;
-    }
-};
-
-key User::seed = 0;
-std::map<key, std::string> User::names{};
-
-std::ostream& operator<<(std::ostream& os, const User& obj)
-{
-    return os << "first_name: " << obj.get_first_name() << " last_name: " << obj.get_last_name();
-}
+#include "flyweight.hpp"
+#include "user.hpp"
 
 int main()
 {
@@ -64,6 +22,17 @@ int main()
 
     std::cout << user_1 << std::endl;
     std::cout << user_2 << std::endl;
-    
+
+    InternerStats stats = User::name_stats();
+    std::cout << stats.distinct_strings << " distinct names, " << stats.bytes_used
+              << " bytes, dedup ratio " << stats.dedup_ratio() << std::endl;
+
+    // any other repeated field can be shared the same way
+    typedef Flyweight<std::string, std::hash<std::string>, std::equal_to<std::string>, ThreadSafeStorage> City;
+    static_assert(sizeof(City) == sizeof(key));
+    City city_1{"London"}, city_2{"Paris"}, city_3{"London"};
+    std::cout << *city_1 << " " << *city_2 << " " << *city_3 << ": " << City::distinct()
+              << " distinct cities, same handle " << (city_1 == city_3) << std::endl;
+
     return 0;
 }
\ No newline at end of file
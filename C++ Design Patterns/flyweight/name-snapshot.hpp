@@ -0,0 +1,361 @@
+/*
+ * Memory-mapped snapshot of the interned names
+ *
+ * Re-interning every name after a restart takes time proportional to the number of names.
+ * Instead, the table can be written to a file laid out exactly as it is used:
+ *
+ *     header      magic, version, name count, key count, index capacity, blob size
+ *     refs        one StringRef (offset into blob, length) per key, absent keys hold no_ref
+ *     index       open-addressing hash index: key + 1 per slot, 0 when empty,
+ *                 linear probing from hash_name(name)
+ *     blob        the characters of every name, back to back
+ *
+ * MappedNameTable maps such a file read-only and answers lookups straight from the mapping,
+ * so opening it costs one mmap no matter how many names it holds, and processes that open
+ * the same file share its pages. Keys keep the values they had when the file was written.
+ * The header is validated against the file's length when it is opened; slots and refs
+ * that point outside the file are caught when they are read, and throw.
+ * SnapshotOverlay puts a mutable interner on top of a snapshot for the names that are not
+ * in it yet; their keys start right after the snapshot's keys, and a name whose key would
+ * run past the 32-bit key space is refused with std::length_error. Names in the snapshot live
+ * as long as the mapping, so reference counting only applies to the overlay's names.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "string-interner.hpp"
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    // keys that hold a name; less than key_count when some keys were freed
+    uint32_t name_count;
+    // keys are in [0, key_count)
+    uint64_t key_count;
+    uint64_t index_capacity;
+    uint64_t blob_size;
+};
+
+inline constexpr char snapshot_magic[8] = {'F', 'L', 'Y', 'N', 'A', 'M', 'E', 'S'};
+inline constexpr uint32_t snapshot_version = 2;
+inline constexpr StringRef no_ref = UINT64_MAX;
+
+// Writes every (key, name) pair that for_each_name reports; key_count is one past the largest key.
+template <typename ForEachName>
+void write_snapshot(const std::string& path, uint64_t key_count, ForEachName&& for_each_name)
+{
+    std::vector<StringRef> refs(key_count, no_ref);
+    std::string blob;
+    uint32_t name_count = 0;
+    for_each_name([&](key k, std::string_view name)
+    {
+        refs[k] = (uint64_t{name.size()} << 40) | blob.size();
+        blob.append(name);
+        ++name_count;
+    });
+
+    uint64_t capacity = 16;
+    while (capacity < key_count * 2)
+        capacity *= 2;
+    std::vector<uint32_t> index(capacity, 0);
+    for (uint64_t k = 0; k < key_count; ++k)
+    {
+        if (refs[k] == no_ref)
+            continue;
+        std::string_view name{blob.data() + (refs[k] & ((uint64_t{1} << 40) - 1)), static_cast<size_t>(refs[k] >> 40)};
+        size_t i = hash_name(name) & (capacity - 1);
+        while (index[i] != 0)
+            i = (i + 1) & (capacity - 1);
+        index[i] = static_cast<uint32_t>(k + 1);
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, snapshot_magic, sizeof header.magic);
+    header.version = snapshot_version;
+    header.name_count = name_count;
+    header.key_count = key_count;
+    header.index_capacity = capacity;
+    header.blob_size = blob.size();
+
+    // write to a temporary file and rename it, so readers never map a half-written file
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof header);
+        out.write(reinterpret_cast<const char*>(refs.data()), static_cast<std::streamsize>(refs.size() * sizeof(StringRef)));
+        out.write(reinterpret_cast<const char*>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(uint32_t)));
+        out.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+        if (!out)
+            throw std::runtime_error("cannot write " + temporary);
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("cannot replace " + path);
+}
+
+class MappedNameTable
+{
+public:
+    MappedNameTable() = default;
+
+    explicit MappedNameTable(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("cannot open " + path);
+        struct stat info{};
+        if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SnapshotHeader))
+        {
+            ::close(fd);
+            throw std::runtime_error(path + " is not a name snapshot");
+        }
+        length = static_cast<size_t>(info.st_size);
+        void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            throw std::runtime_error("cannot map " + path);
+        address = static_cast<const char*>(mapped);
+
+        auto header = reinterpret_cast<const SnapshotHeader*>(address);
+        if (!valid(*header, length - sizeof(SnapshotHeader)))
+        {
+            unmap();
+            throw std::runtime_error(path + " is not a name snapshot");
+        }
+        count = header->key_count;
+        names = header->name_count;
+        mask = header->index_capacity - 1;
+        blob_size = header->blob_size;
+        refs = reinterpret_cast<const StringRef*>(address + sizeof(SnapshotHeader));
+        index = reinterpret_cast<const uint32_t*>(refs + count);
+        blob = reinterpret_cast<const char*>(index + header->index_capacity);
+    }
+
+    ~MappedNameTable() { unmap(); }
+
+    MappedNameTable(MappedNameTable&& other) noexcept { *this = std::move(other); }
+
+    MappedNameTable& operator=(MappedNameTable&& other) noexcept
+    {
+        std::swap(address, other.address);
+        std::swap(length, other.length);
+        std::swap(count, other.count);
+        std::swap(names, other.names);
+        std::swap(mask, other.mask);
+        std::swap(blob_size, other.blob_size);
+        std::swap(refs, other.refs);
+        std::swap(index, other.index);
+        std::swap(blob, other.blob);
+        return *this;
+    }
+
+    std::optional<key> find(std::string_view name) const
+    {
+        if (!count)
+            return std::nullopt;
+        // at most one pass over the index, even if a corrupt file left it without an empty slot
+        size_t i = hash_name(name) & mask;
+        for (uint64_t probes = 0; probes <= mask; ++probes, i = (i + 1) & mask)
+        {
+            uint32_t slot = index[i];
+            if (slot == 0)
+                return std::nullopt;
+            if (slot > count)
+                corrupt();
+            if (get(slot - 1) == name)
+                return slot - 1;
+        }
+        return std::nullopt;
+    }
+
+    // k must be below key_count()
+    std::string_view get(key k) const
+    {
+        StringRef ref = refs[k];
+        uint64_t offset = ref & ((uint64_t{1} << 40) - 1);
+        uint64_t size = ref >> 40;
+        if (offset > blob_size || size > blob_size - offset)
+            corrupt();
+        return {blob + offset, static_cast<size_t>(size)};
+    }
+
+    bool contains(key k) const { return k < count && refs[k] != no_ref; }
+
+    // one past the largest key in the snapshot
+    uint64_t key_count() const { return count; }
+
+    // keys that hold a name
+    uint64_t name_count() const { return names; }
+
+    // characters of all the names
+    uint64_t payload_bytes() const { return blob_size; }
+
+    size_t mapped_bytes() const { return length; }
+
+private:
+    // Checks the header against the bytes that follow it. The index and the refs are only
+    // checked when they are used, so that opening the file does not read all of it.
+    static bool valid(const SnapshotHeader& header, uint64_t available)
+    {
+        if (std::memcmp(header.magic, snapshot_magic, sizeof snapshot_magic) != 0 || header.version != snapshot_version
+            || header.name_count > header.key_count)
+            return false;
+        uint64_t capacity = header.index_capacity;
+        // a power of two with room to spare, so that probing finds an empty slot,
+        // and keys that fit in the 32-bit slots
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0 || header.key_count >= capacity
+            || header.key_count >= UINT32_MAX)
+            return false;
+        if (header.key_count > available / sizeof(StringRef))
+            return false;
+        available -= header.key_count * sizeof(StringRef);
+        if (capacity > available / sizeof(uint32_t))
+            return false;
+        available -= capacity * sizeof(uint32_t);
+        return header.blob_size == available;
+    }
+
+    [[noreturn]] static void corrupt()
+    {
+        throw std::runtime_error("corrupt name snapshot");
+    }
+
+    void unmap()
+    {
+        if (address)
+            ::munmap(const_cast<char*>(address), length);
+        address = nullptr;
+    }
+
+    const char* address = nullptr;
+    size_t length = 0;
+    uint64_t count = 0;
+    uint64_t names = 0;
+    uint64_t mask = 0;
+    uint64_t blob_size = 0;
+    const StringRef* refs = nullptr;
+    const uint32_t* index = nullptr;
+    const char* blob = nullptr;
+};
+
+// A read-only snapshot with an in-memory Interner for the names added since it was written.
+// open() must be called before any name is interned.
+template <typename Interner>
+class SnapshotOverlay
+{
+public:
+    void open(const std::string& path)
+    {
+        snapshot = MappedNameTable{path};
+    }
+
+    key intern(std::string_view name)
+    {
+        if (auto k = snapshot.find(name))
+            return found(*k);
+        // acquired first, so that a key that does not fit is given back rather than pinned
+        key k = acquire_in_overlay(name);
+        overlay.intern(name);
+        overlay.release(k - base());
+        return k;
+    }
+
+    key acquire(std::string_view name)
+    {
+        if (auto k = snapshot.find(name))
+            return found(*k);
+        return acquire_in_overlay(name);
+    }
+
+    void retain(key k)
+    {
+        if (k >= base())
+            overlay.retain(k - base());
+    }
+
+    void release(key k)
+    {
+        if (k >= base())
+            overlay.release(k - base());
+    }
+
+    std::string_view get(key k) const
+    {
+        return k < base() ? snapshot.get(k) : overlay.get(k - base());
+    }
+
+    // Writes the snapshot and the overlay into one new snapshot, keeping every key.
+    void save(const std::string& path) const
+    {
+        uint64_t key_count = base();
+        overlay.for_each([&](key k, std::string_view) { key_count = std::max<uint64_t>(key_count, base() + k + 1); });
+        write_snapshot(path, key_count, [&](auto&& emit)
+        {
+            for (key k = 0; k < base(); ++k)
+                if (snapshot.contains(k))
+                    emit(k, snapshot.get(k));
+            overlay.for_each([&](key k, std::string_view name) { emit(base() + k, name); });
+        });
+    }
+
+    // The snapshot's names count like any other: they are distinct from the overlay's,
+    // and the mapping is memory the table holds.
+    InternerStats stats()
+    {
+        InternerStats result = overlay.stats();
+        result.distinct_strings += snapshot.name_count();
+        result.intern_calls += snapshot_hits.load(std::memory_order_relaxed);
+        result.payload_bytes += snapshot.payload_bytes();
+        result.bytes_used += snapshot.mapped_bytes();
+        return result;
+    }
+
+    const MappedNameTable& mapped() const { return snapshot; }
+    Interner& in_memory() { return overlay; }
+
+private:
+    key base() const { return static_cast<key>(snapshot.key_count()); }
+
+    key found(key k)
+    {
+        snapshot_hits.fetch_add(1, std::memory_order_relaxed);
+        return k;
+    }
+
+    // Throws if the overlay's key for name, offset by the snapshot's keys, does not fit in a key.
+    key acquire_in_overlay(std::string_view name)
+    {
+        key k = overlay.acquire(name);
+        if (k > std::numeric_limits<key>::max() - base())
+        {
+            overlay.release(k);
+            throw std::length_error("too many names in the overlay for 32-bit keys");
+        }
+        return base() + k;
+    }
+
+    MappedNameTable snapshot;
+    Interner overlay;
+    // intern() and acquire() calls answered by the snapshot
+    std::atomic<size_t> snapshot_hits{0};
+};
@@ -0,0 +1,88 @@
+/*
+ * Append-only array with stable elements and lock-free reads
+ *
+ * Elements live in segments whose sizes double (B, 2B, 4B, ...), so growing never moves
+ * an existing element and a reference to an element stays valid for the array's lifetime.
+ * Appending must be serialized by the caller (e.g. under a mutex), but reading an element
+ * needs no lock, as long as the reader learned the element's index through
+ * an operation that synchronizes with the append (a mutex, or an atomic release store
+ * paired with an acquire load). That is how the concurrent interner publishes new names.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+template <typename T, unsigned FirstSegmentBits = 8>
+class SegmentedArray
+{
+public:
+    SegmentedArray()
+    {
+        for (auto& segment : segments)
+            segment.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~SegmentedArray()
+    {
+        size_t n = count.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < n; ++i)
+            (*this)[i].~T();
+        for (auto& segment : segments)
+            if (T* data = segment.load(std::memory_order_relaxed))
+                ::operator delete(data, std::align_val_t{alignof(T)});
+    }
+
+    SegmentedArray(SegmentedArray const&) = delete;
+    void operator=(SegmentedArray const&) = delete;
+
+    T& operator[](size_t i) const
+    {
+        size_t segment, offset;
+        locate(i, segment, offset);
+        return segments[segment].load(std::memory_order_acquire)[offset];
+    }
+
+    // Constructs a new element at the end and returns its index; callers must not
+    // append concurrently.
+    template <typename... Args>
+    size_t emplace_back(Args&&... args)
+    {
+        size_t i = count.load(std::memory_order_relaxed);
+        size_t segment, offset;
+        locate(i, segment, offset);
+        T* data = segments[segment].load(std::memory_order_relaxed);
+        if (!data)
+        {
+            size_t capacity = size_t{1} << (segment + FirstSegmentBits);
+            data = static_cast<T*>(::operator new(capacity * sizeof(T), std::align_val_t{alignof(T)}));
+            segments[segment].store(data, std::memory_order_release);
+        }
+        new (data + offset) T(std::forward<Args>(args)...);
+        count.store(i + 1, std::memory_order_release);
+        return i;
+    }
+
+    size_t size() const { return count.load(std::memory_order_acquire); }
+
+private:
+    // enough segments to hold 2^32 elements
+    static constexpr unsigned segment_count = 33 - FirstSegmentBits;
+
+    static void locate(size_t i, size_t& segment, size_t& offset)
+    {
+        // shifting by the first segment's size makes the segment number a bit position:
+        // segment k covers [B * (2^k - 1), B * (2^(k+1) - 1))
+        uint64_t j = uint64_t{i} + (uint64_t{1} << FirstSegmentBits);
+        unsigned top = 63 - static_cast<unsigned>(__builtin_clzll(j));
+        segment = top - FirstSegmentBits;
+        offset = j - (uint64_t{1} << top);
+    }
+
+    mutable std::atomic<T*> segments[segment_count];
+    std::atomic<size_t> count{0};
+};
@@ -0,0 +1,126 @@
+/*
+ * String arena
+ *
+ * Stores strings back to back in large chunks instead of one heap block per string.
+ * A stored string is identified by a StringRef, a single 64-bit word packing its offset
+ * in the arena (low 40 bits) and its length (high 24 bits), so a table of interned names
+ * costs 8 bytes per name on top of the characters themselves.
+ *
+ * Offsets are logical: chunk i covers offsets [i * chunk size, (i + 1) * chunk size)
+ * and a directory maps chunk numbers to memory. A string never straddles two chunks;
+ * a string longer than a chunk gets a block of its own that is entered in the directory
+ * as several consecutive chunks, so resolving an offset is always one directory lookup.
+ * Storing must be serialized by the caller, resolving a published StringRef is lock-free.
+ * Released strings of up to 255 characters are kept on per-length free lists, and
+ * the next string of the same length reuses their bytes.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "segmented-array.hpp"
+
+typedef uint64_t StringRef;
+
+class StringArena
+{
+public:
+    static constexpr unsigned chunk_bits = 16;
+    static constexpr size_t chunk_size = size_t{1} << chunk_bits;
+    static constexpr size_t max_length = (size_t{1} << 24) - 1;
+    // longest string whose bytes are reused after release()
+    static constexpr size_t max_reused_length = 255;
+
+    StringArena() = default;
+    StringArena(StringArena const&) = delete;
+    void operator=(StringArena const&) = delete;
+
+    StringRef store(std::string_view s)
+    {
+        if (s.size() > max_length)
+            throw std::length_error("string too long for the arena");
+        if (s.empty())
+            return 0;
+
+        if (s.size() <= max_reused_length && !free_lists[s.size()].empty())
+        {
+            StringRef ref = free_lists[s.size()].back();
+            free_lists[s.size()].pop_back();
+            std::memcpy(address(ref & offset_mask), s.data(), s.size());
+            payload += s.size();
+            return ref;
+        }
+
+        if ((next & (chunk_size - 1)) + s.size() > chunk_size || (next >> chunk_bits) >= chunks.size())
+            start_chunk(s.size());
+
+        uint64_t offset = next;
+        std::memcpy(address(offset), s.data(), s.size());
+        next += s.size();
+        payload += s.size();
+        return (uint64_t{s.size()} << 40) | offset;
+    }
+
+    // Makes the bytes of ref available to later strings; ref must not be used afterwards.
+    void release(StringRef ref)
+    {
+        size_t length = static_cast<size_t>(ref >> 40);
+        payload -= length;
+        if (length != 0 && length <= max_reused_length)
+            free_lists[length].push_back(ref);
+    }
+
+    std::string_view get(StringRef ref) const
+    {
+        size_t length = static_cast<size_t>(ref >> 40);
+        if (length == 0)
+            return {};
+        return {address(ref & offset_mask), length};
+    }
+
+    // bytes of string data stored
+    size_t payload_bytes() const { return payload; }
+
+    // bytes of memory held by the arena
+    size_t reserved_bytes() const { return reserved; }
+
+private:
+    static constexpr uint64_t offset_mask = (uint64_t{1} << 40) - 1;
+
+    char* address(uint64_t offset) const
+    {
+        return chunks[offset >> chunk_bits] + (offset & (chunk_size - 1));
+    }
+
+    // Starts a new chunk (or run of chunks) big enough for length bytes.
+    void start_chunk(size_t length)
+    {
+        // the rest of the current chunk is abandoned
+        next = (next + chunk_size - 1) & ~uint64_t{chunk_size - 1};
+        if (next + length > offset_mask)
+            throw std::length_error("string arena is full");
+
+        size_t count = (length + chunk_size - 1) / chunk_size;
+        blocks.emplace_back(new char[count * chunk_size]);
+        reserved += count * chunk_size;
+        // strings stored after a big one use what is left of its last chunk
+        for (size_t i = 0; i < count; ++i)
+            chunks.emplace_back(blocks.back().get() + i * chunk_size);
+    }
+
+    SegmentedArray<char*> chunks;
+    // released strings by length
+    std::vector<StringRef> free_lists[max_reused_length + 1];
+    // memory owned by the arena, only touched by the writer
+    std::vector<std::unique_ptr<char[]>> blocks;
+    uint64_t next = 0;
+    size_t payload = 0;
+    size_t reserved = 0;
+};
@@ -0,0 +1,143 @@
+/*
+ * String interner
+ *
+ * The shared state of the User flyweight: every distinct name is stored once
+ * and identified by a small integer key.
+ * Keys are dense (0, 1, 2, ...), so looking up the string of a key is an index
+ * into a table. Looking up the key of a string goes through an open-addressing
+ * hash table of keys with linear probing, which also stores the hash of each name
+ * so that probing rarely has to compare strings. Both directions are O(1).
+ * The characters live back to back in a StringArena and the key table only holds
+ * an 8-byte StringRef per name; stats() reports how much memory that takes.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "string-arena.hpp"
+
+typedef uint32_t key;
+
+struct InternerStats
+{
+    size_t distinct_strings = 0;
+    // calls to intern(), including those that found the string already there
+    size_t intern_calls = 0;
+    // characters of the distinct strings
+    size_t payload_bytes = 0;
+    // memory held by the interner: arena chunks, key table and hash table
+    size_t bytes_used = 0;
+
+    double dedup_ratio() const
+    {
+        return distinct_strings ? static_cast<double>(intern_calls) / distinct_strings : 0.0;
+    }
+};
+
+// 64-bit FNV-1a, defined here rather than relying on std::hash
+// so that hash values are the same in every build and every process
+inline uint64_t hash_name(std::string_view name)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : name)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    // FNV mixes the low bits poorly for short strings, finish with a multiply-xorshift
+    hash ^= hash >> 32;
+    hash *= 0xd6e8feb86659fd93ull;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+class StringInterner
+{
+public:
+    StringInterner()
+        : slots(16, empty) {}
+
+    // Returns the key of s, adding s if it was not interned yet.
+    key intern(std::string_view s)
+    {
+        ++calls;
+        uint64_t hash = hash_name(s);
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            key k = slots[i];
+            if (k == empty)
+                break;
+            if (hashes[k] == hash && get(k) == s)
+                return k;
+        }
+
+        key k = static_cast<key>(names.size());
+        names.push_back(arena.store(s));
+        hashes.push_back(hash);
+        // keep the table at most half full so probe sequences stay short
+        if (names.size() * 2 > slots.size())
+            rehash(slots.size() * 2);
+        else
+            place(k);
+        return k;
+    }
+
+    // The string of a key returned by intern(); the view stays valid.
+    std::string_view get(key k) const
+    {
+        return arena.get(names[k]);
+    }
+
+    size_t size() const { return names.size(); }
+
+    // Calls f(key, name) for every interned name.
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        for (key k = 0; k < names.size(); ++k)
+            f(k, get(k));
+    }
+
+    InternerStats stats() const
+    {
+        InternerStats result;
+        result.distinct_strings = names.size();
+        result.intern_calls = calls;
+        result.payload_bytes = arena.payload_bytes();
+        result.bytes_used = arena.reserved_bytes()
+            + names.capacity() * sizeof(StringRef)
+            + hashes.capacity() * sizeof(uint64_t)
+            + slots.capacity() * sizeof(key);
+        return result;
+    }
+
+private:
+    static constexpr key empty = UINT32_MAX;
+
+    void place(key k)
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = hashes[k] & mask;
+        while (slots[i] != empty)
+            i = (i + 1) & mask;
+        slots[i] = k;
+    }
+
+    void rehash(size_t capacity)
+    {
+        slots.assign(capacity, empty);
+        for (key k = 0; k < names.size(); ++k)
+            place(k);
+    }
+
+    StringArena arena;
+    std::vector<StringRef> names;
+    std::vector<uint64_t> hashes;
+    std::vector<key> slots;
+    size_t calls = 0;
+};
@@ -0,0 +1,113 @@
+/*
+ * User
+ *
+ * A user whose first and last names are flyweights: each User only stores two keys
+ * into a table of names shared by all users (and all threads), and holds a reference
+ * to both names for as long as it lives.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "concurrent-string-interner.hpp"
+#include "name-snapshot.hpp"
+
+struct User
+{
+    User(const std::string& first_name, const std::string& last_name)
+        : first_name{add(first_name)}, last_name{add(last_name)} {}
+
+    // Every User holds a reference to its two names, so a name that no User
+    // uses any more can be reclaimed.
+    User(const User& other)
+        : first_name{other.first_name}, last_name{other.last_name}
+    {
+        names.retain(first_name);
+        names.retain(last_name);
+    }
+
+    User& operator=(const User& other)
+    {
+        names.retain(other.first_name);
+        names.retain(other.last_name);
+        names.release(first_name);
+        names.release(last_name);
+        first_name = other.first_name;
+        last_name = other.last_name;
+        return *this;
+    }
+
+    ~User()
+    {
+        names.release(first_name);
+        names.release(last_name);
+    }
+
+    std::string_view get_first_name() const
+    {
+        return names.get(first_name);
+    }
+
+    std::string_view get_last_name() const
+    {
+        return names.get(last_name);
+    }
+
+    static InternerStats name_stats()
+    {
+        return names.stats();
+    }
+
+    // Maps a table written by save_names(); call it before creating any user.
+    static void load_names(const std::string& path)
+    {
+        names.open(path);
+    }
+
+    static void save_names(const std::string& path)
+    {
+        names.save(path);
+    }
+
+    // Key-level access for code that stores names without a User, such as the bulk loader.
+    // Every key returned by acquire_name() must be given back with release_name().
+    static key acquire_name(std::string_view s)
+    {
+        return names.acquire(s);
+    }
+
+    static void release_name(key k)
+    {
+        names.release(k);
+    }
+
+    static std::string_view name(key k)
+    {
+        return names.get(k);
+    }
+
+    // Frees the names released since the last collection, without waiting for a full batch.
+    static void collect_names()
+    {
+        names.in_memory().collect();
+    }
+
+protected:
+    key first_name, last_name;
+    // shared by every thread that creates users; names loaded from a snapshot
+    // are used straight from the mapped file
+    inline static SnapshotOverlay<ConcurrentStringInterner> names;
+
+    static key add(const std::string& s)
+    {
+        return names.acquire(s);
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const User& obj)
+{
+    return os << "first_name: " << obj.get_first_name() << " last_name: " << obj.get_last_name();
+}
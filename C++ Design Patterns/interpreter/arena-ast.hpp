@@ -0,0 +1,210 @@
+/*
+ * Arena-allocated syntax tree
+ *
+ * An alternative to the Element hierarchy for large rule sets. All nodes of one parse
+ * are plain 16-byte structs stored back to back in a single growing array (a bump arena),
+ * and children are referred to by their 32-bit index in that array instead of by pointer.
+ * There are no virtual calls, no reference counts and no per-node allocations, and
+ * clear() frees the whole tree at once while keeping the memory for the next parse.
+ * Variable names are interned through a small hash table, so each use is O(1).
+ *
+ * The parser creates operands before the operations that use them, so every node has
+ * a larger index than its children. Evaluation is therefore a backward pass that marks
+ * the nodes reachable from the root, then a single forward pass over them, both of which
+ * the hardware prefetcher handles very well.
+ *
+ * AstArena is also a Builder for parse(), see parser.hpp.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "element.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+
+struct AstNode
+{
+    enum Kind : std::uint8_t { integer, variable, operation } kind;
+    // operation type, only meaningful for operations
+    std::uint8_t type;
+    // children of an operation; for a variable, lhs is its slot
+    std::uint32_t lhs, rhs;
+    int value;
+};
+
+class AstArena
+{
+public:
+    typedef std::uint32_t Node;
+
+    explicit AstArena(std::size_t expected_nodes = 0)
+    {
+        nodes.reserve(expected_nodes);
+    }
+
+    Node integer(int value)
+    {
+        return add(AstNode{AstNode::integer, 0, 0, 0, value});
+    }
+
+    // Repeated names share a slot; the values of the slots are passed to eval().
+    Node variable(std::string_view name)
+    {
+        return add(AstNode{AstNode::variable, 0, slot_of(name), 0, 0});
+    }
+
+    Node binary(BinaryOperation::Type type, Node lhs, Node rhs)
+    {
+        return add(AstNode{AstNode::operation, static_cast<std::uint8_t>(type), lhs, rhs, 0});
+    }
+
+    // Evaluates the tree whose root is the given node. Only the nodes reachable from the
+    // root are evaluated, so other trees in the arena, even failing ones, do not matter.
+    // values holds the value of every variable slot; the tree must have no variables
+    // when it is null. Not safe to call from several threads on the same arena,
+    // since it reuses internal buffers.
+    int eval(Node root, const int* values) const
+    {
+        if(root >= nodes.size())
+            throw std::out_of_range("no such node");
+
+        // children have smaller indices than their parents, so one backward pass
+        // from the root marks everything below it
+        reachable.assign(root + 1, false);
+        reachable[root] = true;
+        std::uint32_t first = root;
+        for(std::uint32_t i = root;; --i)
+        {
+            const AstNode& node = nodes[i];
+            if(reachable[i] && node.kind == AstNode::operation)
+            {
+                reachable[node.lhs] = reachable[node.rhs] = true;
+                first = std::min({first, node.lhs, node.rhs});
+            }
+            if(i == first)
+                break;
+        }
+
+        // values of the nodes, computed in index order so children are always ready
+        scratch.resize(root + 1);
+        for(std::uint32_t i = first; i <= root; ++i)
+        {
+            if(!reachable[i])
+                continue;
+            const AstNode& node = nodes[i];
+            switch(node.kind)
+            {
+                case AstNode::integer:
+                    scratch[i] = node.value;
+                    break;
+                case AstNode::variable:
+                    if(!values)
+                        throw std::invalid_argument("no values for the variables of the tree");
+                    scratch[i] = values[node.lhs];
+                    break;
+                case AstNode::operation:
+                    scratch[i] = BinaryOperation::apply(static_cast<BinaryOperation::Type>(node.type),
+                                                        scratch[node.lhs], scratch[node.rhs]);
+                    break;
+            }
+        }
+        return scratch[root];
+    }
+
+    int eval(Node root) const
+    {
+        return eval(root, nullptr);
+    }
+
+    // Frees every node at once; the capacity is kept for the next parse.
+    void clear()
+    {
+        nodes.clear();
+        if(!names.empty())
+            std::fill(index.begin(), index.end(), empty);
+        names.clear();
+        text.clear();
+    }
+
+    std::size_t size() const { return nodes.size(); }
+    std::size_t memory() const
+    {
+        return nodes.capacity() * sizeof(AstNode) + text.capacity() + names.capacity() * sizeof(Name)
+               + index.capacity() * sizeof(std::uint32_t);
+    }
+    std::size_t variable_count() const { return names.size(); }
+    std::string_view name_of(std::uint32_t slot) const { return {text.data() + names[slot].offset, names[slot].length}; }
+    const AstNode& operator[](Node node) const { return nodes[node]; }
+
+private:
+    struct Name
+    {
+        std::uint32_t offset, length;
+    };
+
+    static constexpr std::uint32_t empty = UINT32_MAX;
+
+    // The slot of name, which gets the next free one when it is new.
+    std::uint32_t slot_of(std::string_view name)
+    {
+        // at most half full, so probes stay short
+        if((names.size() + 1) * 2 > index.size())
+            grow_index();
+        std::size_t mask = index.size() - 1;
+        for(std::size_t i = std::hash<std::string_view>{}(name) & mask;; i = (i + 1) & mask)
+        {
+            if(index[i] == empty)
+            {
+                index[i] = static_cast<std::uint32_t>(names.size());
+                names.push_back(Name{static_cast<std::uint32_t>(text.size()), static_cast<std::uint32_t>(name.size())});
+                text.insert(text.end(), name.begin(), name.end());
+                return index[i];
+            }
+            if(name_of(index[i]) == name)
+                return index[i];
+        }
+    }
+
+    void grow_index()
+    {
+        index.assign(std::max<std::size_t>(16, index.size() * 2), empty);
+        std::size_t mask = index.size() - 1;
+        for(std::uint32_t slot = 0; slot < names.size(); ++slot)
+        {
+            std::size_t i = std::hash<std::string_view>{}(name_of(slot)) & mask;
+            while(index[i] != empty)
+                i = (i + 1) & mask;
+            index[i] = slot;
+        }
+    }
+
+    Node add(const AstNode& node)
+    {
+        if(nodes.size() == UINT32_MAX)
+            throw std::length_error("too many nodes for 32-bit indices");
+        nodes.push_back(node);
+        return static_cast<Node>(nodes.size() - 1);
+    }
+
+    std::vector<AstNode> nodes;
+    std::vector<Name> names;
+    std::vector<char> text;
+    // open-addressing hash table of slots, keyed by their name; a power of two in size
+    std::vector<std::uint32_t> index;
+    mutable std::vector<int> scratch;
+    mutable std::vector<char> reachable;
+};
+
+// Parses the tokens into the arena, which should be empty, and returns the root.
+inline AstArena::Node parse_into(AstArena& arena, const std::vector<TokenView>& tokens)
+{
+    return parse(tokens, arena);
+}
@@ -0,0 +1,302 @@
+/*
+ * Bulk expression evaluation
+ *
+ * Evaluates a file with one expression per line and prints one result per line,
+ * in the same order as the input.
+ * The file is memory-mapped and split into lines without copying. Lines are processed
+ * in windows: a pool of worker threads, started once, takes blocks of lines of the current
+ * window from a shared counter, then the main thread writes the window's results and
+ * hands the workers the next one.
+ * Parsed trees are kept in a concurrent LRU cache keyed by the expression text,
+ * so a formula that repeats is lexed and parsed only once; so are the errors of lines
+ * that do not parse.
+ *
+ * usage: batch-eval <file> [threads] [cache capacity]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <charconv>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "lexer.hpp"
+#include "lru-cache.hpp"
+#include "parser.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result
+{
+    int value = 0;
+    // empty when the line evaluated successfully
+    std::string error;
+};
+
+// A line as the cache keeps it: its tree, or why it could not be lexed or parsed,
+// so that a bad line that repeats is not lexed and parsed again either.
+struct Parsed
+{
+    std::shared_ptr<Element> tree;
+    std::string error;
+};
+
+// nanoseconds spent in each stage, summed over all threads
+struct StageTimes
+{
+    std::atomic<long long> lex{0}, parse{0}, eval{0};
+};
+
+class BatchEvaluator
+{
+public:
+    // starts threads - 1 workers; the thread calling run() is the last one
+    BatchEvaluator(std::size_t threads, std::size_t cache_capacity)
+        : cache(cache_capacity)
+    {
+        for(std::size_t t = 1; t < threads; ++t)
+            workers.emplace_back([this]() { work(); });
+    }
+
+    ~BatchEvaluator()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        window_ready.notify_all();
+        for(auto& worker: workers)
+            worker.join();
+    }
+
+    BatchEvaluator(BatchEvaluator const&) = delete;
+    void operator=(BatchEvaluator const&) = delete;
+
+    void run(const std::vector<std::string_view>& lines, std::ostream& out)
+    {
+        const std::size_t window = 1 << 16;
+        std::vector<Result> results(std::min(window, lines.size()));
+        std::string buffer;
+
+        for(std::size_t first = 0; first < lines.size(); first += window)
+        {
+            std::size_t count = std::min(window, lines.size() - first);
+            evaluate_window(&lines[first], count, results.data());
+
+            buffer.clear();
+            for(std::size_t i = 0; i < count; ++i)
+                append(buffer, results[i]);
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        }
+    }
+
+    const StageTimes& stage_times() const { return times; }
+    double hit_rate() const { return cache.hit_rate(); }
+
+private:
+    // Hands the window to the workers, helps with it and returns once it is done.
+    void evaluate_window(const std::string_view* lines, std::size_t count, Result* results)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            window = Window{lines, count, results};
+            next = 0;
+            busy = workers.size();
+            ++generation;
+        }
+        window_ready.notify_all();
+
+        take_blocks();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        window_done.wait(lock, [this]() { return busy == 0; });
+    }
+
+    // Body of every worker: one call of take_blocks() per window.
+    void work()
+    {
+        std::uint64_t seen = 0;
+        for(;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                window_ready.wait(lock, [&]() { return stopping || generation != seen; });
+                if(stopping)
+                    return;
+                seen = generation;
+            }
+            take_blocks();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(--busy == 0)
+                    window_done.notify_one();
+            }
+        }
+    }
+
+    // Evaluates blocks of lines of the current window until none is left.
+    void take_blocks()
+    {
+        const std::size_t block = 256;
+        long long lex_ns = 0, parse_ns = 0, eval_ns = 0;
+        for(;;)
+        {
+            std::size_t begin = next.fetch_add(block);
+            if(begin >= window.count)
+                break;
+            std::size_t end = std::min(begin + block, window.count);
+            for(std::size_t i = begin; i < end; ++i)
+                window.results[i] = evaluate(window.lines[i], lex_ns, parse_ns, eval_ns);
+        }
+        times.lex += lex_ns;
+        times.parse += parse_ns;
+        times.eval += eval_ns;
+    }
+
+    Result evaluate(std::string_view line, long long& lex_ns, long long& parse_ns, long long& eval_ns)
+    {
+        Result result;
+        auto parsed = cache.get(line);
+        if(!parsed)
+        {
+            parsed.emplace();
+            auto start = Clock::now();
+            std::optional<Clock::time_point> lexed;
+            try
+            {
+                auto tokens = lex_view(line);
+                lexed = Clock::now();
+                parsed->tree = parse(tokens);
+            }
+            catch(const std::exception& e)
+            {
+                parsed->error = e.what();
+            }
+            auto end = Clock::now();
+            // a line that does not lex is all lexing time
+            lex_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(lexed.value_or(end) - start).count();
+            parse_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end - lexed.value_or(end)).count();
+            cache.put(line, *parsed);
+        }
+
+        if(!parsed->tree)
+        {
+            result.error = parsed->error;
+            return result;
+        }
+        try
+        {
+            auto start = Clock::now();
+            result.value = parsed->tree->eval();
+            eval_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        }
+        catch(const std::exception& e)
+        {
+            result.error = e.what();
+        }
+        return result;
+    }
+
+    static void append(std::string& buffer, const Result& result)
+    {
+        if(!result.error.empty())
+        {
+            buffer += "error: ";
+            buffer += result.error;
+        }
+        else
+        {
+            char digits[16];
+            auto [end, ec] = std::to_chars(digits, digits + sizeof digits, result.value);
+            buffer.append(digits, end);
+        }
+        buffer += '\n';
+    }
+
+    struct Window
+    {
+        const std::string_view* lines = nullptr;
+        std::size_t count = 0;
+        Result* results = nullptr;
+    };
+
+    ConcurrentLruCache<Parsed> cache;
+    StageTimes times;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable window_ready, window_done;
+    // the current window, published under mutex together with a new generation
+    Window window;
+    std::uint64_t generation = 0;
+    // workers that have not finished the current window yet
+    std::size_t busy = 0;
+    bool stopping = false;
+    // first line of the window that no thread has taken yet
+    std::atomic<std::size_t> next{0};
+};
+
+std::vector<std::string_view> split_lines(std::string_view text)
+{
+    std::vector<std::string_view> lines;
+    while(!text.empty())
+    {
+        std::size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        if(!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        lines.push_back(line);
+        if(end == std::string_view::npos)
+            break;
+        text.remove_prefix(end + 1);
+    }
+    return lines;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <file> [threads] [cache capacity]" << std::endl;
+        return 1;
+    }
+
+    std::size_t threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+    std::size_t capacity = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 4096;
+
+    try
+    {
+        auto start = Clock::now();
+        MappedFile file{argv[1]};
+        auto lines = split_lines(file.view());
+
+        BatchEvaluator evaluator{std::max<std::size_t>(threads, 1), capacity};
+        evaluator.run(lines, std::cout);
+        std::cout.flush();
+
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        auto& times = evaluator.stage_times();
+        std::cerr << lines.size() << " lines in " << elapsed.count() << " s ("
+                  << lines.size() / elapsed.count() << " lines/s)\n"
+                  << "cache hit rate: " << evaluator.hit_rate() * 100 << "%\n"
+                  << "lex: " << times.lex / 1e6 << " ms, parse: " << times.parse / 1e6
+                  << " ms, eval: " << times.eval / 1e6 << " ms (summed over threads)" << std::endl;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Benchmark of the bytecode VM against the tree-walking interpreter
+ *
+ * A pseudo-random expression is parsed once and then evaluated many times,
+ * first by walking the tree with Element::eval, then through the VM with and without
+ * constant folding. The expression only contains constants, so the folded program
+ * is a single push; the unfolded one shows the cost of actually running the VM.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "bytecode.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+
+std::string random_expression(std::mt19937& rng, int depth)
+{
+    if(depth == 0)
+        return std::to_string(rng() % 100 + 1);
+
+    // no '*', a deep product of random numbers would overflow int
+    static const char operators[] = {'+', '-'};
+    return "(" + random_expression(rng, depth - 1) + operators[rng() % 2] + random_expression(rng, depth - 1) + ")";
+}
+
+template <typename F>
+double measure(const char* name, int iterations, F&& f)
+{
+    volatile int sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < iterations; ++i)
+        sink = sink + f();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    double per_call = elapsed.count() / iterations;
+    std::cout << name << ": " << per_call << " ns per evaluation" << std::endl;
+    return per_call;
+}
+
+int main()
+{
+    std::mt19937 rng{42};
+    std::string input = random_expression(rng, 8);
+    auto tree = parse(lex_view(input));
+    auto program = compile(*tree, false);
+    auto folded = compile(*tree);
+
+    std::cout << "expression with " << program.code.size() - 1 << " instructions, "
+              << "max stack " << program.max_stack << std::endl;
+
+    if(tree->eval() != program.run() || tree->eval() != folded.run())
+    {
+        std::cerr << "VM and tree disagree" << std::endl;
+        return 1;
+    }
+
+    const int iterations = 200000;
+    double tree_time = measure("Element::eval        ", iterations, [&]{ return tree->eval(); });
+    double vm_time = measure("VM (no folding)      ", iterations, [&]{ return program.run(); });
+    measure("VM (folded)          ", iterations, [&]{ return folded.run(); });
+
+    std::cout << "speedup without folding: " << tree_time / vm_time << "x" << std::endl;
+    return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * Bytecode compiler and stack virtual machine
+ *
+ * Walking the Element tree costs a virtual call and two pointer chases per node.
+ * For expressions that are evaluated over and over it is cheaper to compile the tree once
+ * into a flat array of instructions in postfix order and run that on a small stack machine:
+ * integers push their value, operators pop two values and push the result.
+ * While compiling, every subtree that only contains constants is evaluated right away
+ * (constant folding) and replaced by a single push, unless it divides by zero or
+ * overflows an int; those are left to run time, like in the tree.
+ * Variables are compiled to loads from a slot; the caller passes the slot values to run().
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "element.hpp"
+
+struct Instruction
+{
+    enum OpCode : std::uint8_t { push, load, add, subtract, multiply, divide, ret } op;
+    int operand;
+};
+
+struct Program
+{
+    std::vector<Instruction> code;
+    // deepest the value stack gets while running, computed by the compiler
+    std::size_t max_stack = 0;
+    // variable names, in slot order
+    std::vector<std::string> variables;
+
+    // for programs without variables
+    int run() const
+    {
+        return run(nullptr);
+    }
+
+    // values holds one value per entry of variables
+    int run(const int* values) const
+    {
+        if(!values && !variables.empty())
+            throw std::invalid_argument("program has variables but no values were given");
+        // expressions rarely need a deep stack, avoid the allocation for those
+        int small[64];
+        std::vector<int> large;
+        int* stack = small;
+        if(max_stack > 64)
+        {
+            large.resize(max_stack);
+            stack = large.data();
+        }
+        return execute(code.data(), stack, values);
+    }
+
+private:
+    static int execute(const Instruction* pc, int* stack, const int* values)
+    {
+        int* top = stack - 1;
+
+#if defined(__GNUC__)
+        // computed goto: each handler jumps straight to the next one,
+        // which gives the branch predictor one indirect jump per opcode
+        static void* dispatch[] = { &&do_push, &&do_load, &&do_add, &&do_subtract, &&do_multiply, &&do_divide, &&do_ret };
+#define NEXT() goto *dispatch[(pc++)->op]
+        NEXT();
+    do_push:
+        *++top = pc[-1].operand;
+        NEXT();
+    do_load:
+        *++top = values[pc[-1].operand];
+        NEXT();
+    do_add:
+        --top;
+        *top += top[1];
+        NEXT();
+    do_subtract:
+        --top;
+        *top -= top[1];
+        NEXT();
+    do_multiply:
+        --top;
+        *top *= top[1];
+        NEXT();
+    do_divide:
+        --top;
+        if(top[1] == 0)
+            throw std::domain_error("division by zero");
+        *top /= top[1];
+        NEXT();
+    do_ret:
+        return *top;
+#undef NEXT
+#else
+        for(;;)
+        {
+            const Instruction& instruction = *pc++;
+            switch(instruction.op)
+            {
+                case Instruction::push:
+                    *++top = instruction.operand;
+                    break;
+                case Instruction::load:
+                    *++top = values[instruction.operand];
+                    break;
+                case Instruction::add:
+                    --top;
+                    *top += top[1];
+                    break;
+                case Instruction::subtract:
+                    --top;
+                    *top -= top[1];
+                    break;
+                case Instruction::multiply:
+                    --top;
+                    *top *= top[1];
+                    break;
+                case Instruction::divide:
+                    --top;
+                    if(top[1] == 0)
+                        throw std::domain_error("division by zero");
+                    *top /= top[1];
+                    break;
+                case Instruction::ret:
+                    return *top;
+            }
+        }
+#endif
+    }
+};
+
+class Compiler
+{
+public:
+    explicit Compiler(bool fold_constants = true)
+        : fold_constants(fold_constants) {}
+
+    Program compile(const Element& root)
+    {
+        program = Program{};
+        slots.clear();
+        depth = 0;
+        emit(root);
+        program.code.push_back(Instruction{Instruction::ret, 0});
+        return std::move(program);
+    }
+
+private:
+    // Emits the code for e and returns true when e is a constant
+    // that was folded into a single push.
+    bool emit(const Element& e)
+    {
+        if(auto integer = dynamic_cast<const Integer*>(&e))
+        {
+            push(integer->value);
+            return true;
+        }
+
+        if(auto variable = dynamic_cast<const Variable*>(&e))
+        {
+            auto it = slots.find(variable->name);
+            if(it == slots.end())
+            {
+                it = slots.emplace(variable->name, static_cast<int>(program.variables.size())).first;
+                program.variables.push_back(variable->name);
+            }
+            program.code.push_back(Instruction{Instruction::load, it->second});
+            if(++depth > program.max_stack)
+                program.max_stack = depth;
+            return false;
+        }
+
+        if(auto operation = dynamic_cast<const BinaryOperation*>(&e))
+            return emit(operation->type, *operation->lhs, *operation->rhs);
+        if(auto operation = dynamic_cast<const ArenaOperation*>(&e))
+            return emit(operation->type, *operation->lhs, *operation->rhs);
+        throw std::invalid_argument("cannot compile unknown element");
+    }
+
+    // Emits the code for lhs op rhs, folded like a single node.
+    bool emit(BinaryOperation::Type type, const Element& lhs, const Element& rhs)
+    {
+        bool constant = emit(lhs);
+        constant = emit(rhs) && constant;
+
+        int folded;
+        if(constant && fold_constants && fold(type, program.code.end()[-2].operand, program.code.back().operand, folded))
+        {
+            // both operands are the last two pushes, replace them by their result
+            program.code.pop_back();
+            program.code.pop_back();
+            depth -= 2;
+            push(folded);
+            return true;
+        }
+
+        program.code.push_back(Instruction{opcode(type), 0});
+        --depth;
+        return false;
+    }
+
+    // Computes left op right in 64 bits. Returns false, leaving the operation to run time,
+    // when it divides by zero or its result does not fit in an int.
+    static bool fold(BinaryOperation::Type type, long long left, long long right, int& result)
+    {
+        long long value;
+        switch(type)
+        {
+            case BinaryOperation::addition: value = left + right; break;
+            case BinaryOperation::subtraction: value = left - right; break;
+            case BinaryOperation::multiplication: value = left * right; break;
+            default:
+                if(right == 0)
+                    return false;
+                value = left / right;
+                break;
+        }
+        if(value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max())
+            return false;
+        result = static_cast<int>(value);
+        return true;
+    }
+
+    void push(int value)
+    {
+        program.code.push_back(Instruction{Instruction::push, value});
+        if(++depth > program.max_stack)
+            program.max_stack = depth;
+    }
+
+    static Instruction::OpCode opcode(BinaryOperation::Type type)
+    {
+        switch(type)
+        {
+            case BinaryOperation::addition: return Instruction::add;
+            case BinaryOperation::subtraction: return Instruction::subtract;
+            case BinaryOperation::multiplication: return Instruction::multiply;
+            default: return Instruction::divide;
+        }
+    }
+
+    bool fold_constants;
+    Program program;
+    std::map<std::string, int> slots;
+    std::size_t depth = 0;
+};
+
+inline Program compile(const Element& root, bool fold_constants = true)
+{
+    return Compiler{fold_constants}.compile(root);
+}
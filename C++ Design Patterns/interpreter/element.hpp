@@ -0,0 +1,103 @@
+/*
+ * Syntax tree of the interpreter
+ *
+ * Every node of the tree is an Element that knows how to evaluate itself:
+ * an Integer evaluates to its value, a Variable to the value currently bound to it
+ * (evaluating an unbound variable throws)
+ * and a BinaryOperation combines the values of its two operands, which it owns.
+ * An ArenaOperation does the same for trees whose nodes all live in one arena
+ * (see NodeArena in parser.hpp): its operands are plain pointers, owned by the arena.
+ */
+
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+struct Element
+{
+    virtual ~Element() = default;
+    virtual int eval() const = 0;
+};
+
+struct Integer: Element
+{
+    int value;
+
+    Integer(int value)
+        : value(value) {}
+
+    int eval() const override
+    {
+        return value;
+    }
+};
+
+struct Variable: Element
+{
+    std::string name;
+    // current value, assigned by whoever owns the tree; empty until then
+    std::optional<int> value;
+
+    Variable(std::string name)
+        : name(std::move(name)) {}
+
+    int eval() const override
+    {
+        if(!value)
+            throw std::invalid_argument("unbound variable " + name);
+        return *value;
+    }
+};
+
+struct BinaryOperation: Element
+{
+    enum Type { addition, subtraction, multiplication, division} type;
+    std::shared_ptr<Element> lhs, rhs;
+
+    BinaryOperation() = default;
+
+    BinaryOperation(Type type, std::shared_ptr<Element> lhs, std::shared_ptr<Element> rhs)
+        : type(type), lhs(std::move(lhs)), rhs(std::move(rhs)) {}
+
+    int eval() const override
+    {
+        return apply(type, lhs->eval(), rhs->eval());
+    }
+
+    static int apply(Type type, int left, int right)
+    {
+        switch(type)
+        {
+            case addition:
+                return left + right;
+            case subtraction:
+                return left - right;
+            case multiplication:
+                return left * right;
+            case division:
+            default:
+                if(right == 0)
+                    throw std::domain_error("division by zero");
+                return left / right;
+        }
+    }
+};
+
+struct ArenaOperation: Element
+{
+    BinaryOperation::Type type;
+    // owned by the arena that owns this node too
+    const Element* lhs;
+    const Element* rhs;
+
+    ArenaOperation(BinaryOperation::Type type, const Element* lhs, const Element* rhs)
+        : type(type), lhs(lhs), rhs(rhs) {}
+
+    int eval() const override
+    {
+        return BinaryOperation::apply(type, lhs->eval(), rhs->eval());
+    }
+};
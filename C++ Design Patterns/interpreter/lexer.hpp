@@ -0,0 +1,372 @@
+/*
+ * Lexers for the interpreter
+ *
+ * lex() is the original lexer, which copies the text of every token into a std::string.
+ * lex_view() and StreamLexer are the zero-copy variants: a TokenView is a
+ * std::string_view slice of the input plus, for integers, the value already parsed,
+ * so the parser never has to convert text again.
+ * lex_view() and ViewLexer work on input that is already in memory (a std::string or
+ * a MappedFile): lex_view() returns every token, ViewLexer hands them out one at a time,
+ * so a mapped file of any size is lexed without holding its tokens.
+ * StreamLexer pulls the input from a std::istream in fixed-size chunks,
+ * so arbitrarily large inputs can be lexed with a constant amount of memory.
+ * Identifiers (a letter or '_' followed by letters, digits or '_') name variables.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct Token
+{
+    enum Type { integer, identifier, plus, minus, times, divide, lparen, rparen} type;
+    std::string text;
+
+    Token(Type type, const std::string &text)
+        : type(type), text(text) {}
+
+    friend std::ostream& operator<<(std::ostream& os, const Token& obj)
+    {
+        os << "`" << obj.text << "`";
+        return os;
+    }
+};
+
+inline std::vector<Token> lex(const std::string& input)
+{
+    std::vector<Token> result;
+
+    for(size_t i = 0; i < input.size(); ++i)
+    {
+        switch(input[i])
+        {
+            case '+':
+                result.push_back(Token{Token::plus, "+"});
+                break;
+            case '-':
+                result.push_back(Token{Token::minus, "-"});
+                break;
+            case '*':
+                result.push_back(Token{Token::times, "*"});
+                break;
+            case '/':
+                result.push_back(Token{Token::divide, "/"});
+                break;
+            case '(':
+                result.push_back(Token{Token::lparen, "("});
+                break;
+            case ')':
+                result.push_back(Token{Token::rparen, ")"});
+                break;
+            default:
+                if(isalpha(input[i]) || input[i] == '_')
+                {
+                    std::string name(1, input[i]);
+                    while(i + 1 < input.size() && (isalnum(input[i+1]) || input[i+1] == '_'))
+                    {
+                        name += input[i+1];
+                        ++i;
+                    }
+                    result.push_back(Token{Token::identifier, name});
+                    break;
+                }
+                std::string buffer(1, input[i]);
+                while(i + 1 < input.size() && isdigit(input[i+1]))
+                {
+                    buffer += input[i+1];
+                    ++i;
+                }
+                // emitted even when the integer is the last thing in the input
+                result.push_back(Token{Token::integer, buffer});
+        }
+    }
+
+    return result;
+}
+
+struct TokenView
+{
+    Token::Type type;
+    std::string_view text;
+    // parsed value of an integer token, 0 for every other type
+    int value;
+
+    friend std::ostream& operator<<(std::ostream& os, const TokenView& obj)
+    {
+        return os << "`" << obj.text << "`";
+    }
+};
+
+namespace detail
+{
+    inline bool is_digit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline bool is_identifier_start(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    inline bool is_identifier_char(char c)
+    {
+        return is_identifier_start(c) || is_digit(c);
+    }
+
+    inline bool is_space(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    inline bool single_char_token(char c, Token::Type& type)
+    {
+        switch(c)
+        {
+            case '+': type = Token::plus; return true;
+            case '-': type = Token::minus; return true;
+            case '*': type = Token::times; return true;
+            case '/': type = Token::divide; return true;
+            case '(': type = Token::lparen; return true;
+            case ')': type = Token::rparen; return true;
+            default: return false;
+        }
+    }
+
+    inline int parse_integer(std::string_view digits)
+    {
+        int value = 0;
+        auto [ptr, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+        if(ec == std::errc::result_out_of_range)
+            throw std::out_of_range("integer literal out of range: " + std::string{digits});
+        if(ec != std::errc() || ptr != digits.data() + digits.size())
+            throw std::invalid_argument("invalid integer literal: " + std::string{digits});
+        return value;
+    }
+
+    [[noreturn]] inline void unexpected(char c)
+    {
+        throw std::invalid_argument(std::string{"unexpected character '"} + c + "'");
+    }
+}
+
+// Lexes input that is already in memory one token at a time, so a large MappedFile can
+// be processed as a stream. The returned views point into input.
+class ViewLexer
+{
+public:
+    explicit ViewLexer(std::string_view input)
+        : p(input.data()), end(input.data() + input.size()) {}
+
+    bool next(TokenView& token)
+    {
+        while(p != end && detail::is_space(*p))
+            ++p;
+        if(p == end)
+            return false;
+
+        Token::Type type;
+        const char* start = p;
+        if(detail::single_char_token(*p, type))
+        {
+            ++p;
+            token = TokenView{type, std::string_view{start, 1}, 0};
+        }
+        else if(detail::is_digit(*p))
+        {
+            while(p != end && detail::is_digit(*p))
+                ++p;
+            std::string_view digits{start, static_cast<size_t>(p - start)};
+            token = TokenView{Token::integer, digits, detail::parse_integer(digits)};
+        }
+        else if(detail::is_identifier_start(*p))
+        {
+            while(p != end && detail::is_identifier_char(*p))
+                ++p;
+            token = TokenView{Token::identifier, std::string_view{start, static_cast<size_t>(p - start)}, 0};
+        }
+        else
+        {
+            detail::unexpected(*p);
+        }
+        return true;
+    }
+
+private:
+    const char* p;
+    const char* end;
+};
+
+// Lexes the whole input at once; the returned views point into input.
+inline std::vector<TokenView> lex_view(std::string_view input)
+{
+    std::vector<TokenView> result;
+    // size the vector from the token density of a prefix, instead of one token per character
+    const size_t sample = 4096;
+    if(input.size() > sample)
+    {
+        ViewLexer lexer{input.substr(0, sample)};
+        TokenView token;
+        size_t count = 0;
+        try
+        {
+            while(lexer.next(token))
+                ++count;
+        }
+        catch(const std::exception&)
+        {
+            // the sample may end inside a token, or the input is invalid; lexing reports it
+        }
+        result.reserve(count * (input.size() / sample) + count + 16);
+    }
+
+    ViewLexer lexer{input};
+    TokenView token;
+    while(lexer.next(token))
+        result.push_back(token);
+    return result;
+}
+
+// Lexes a std::istream chunk by chunk.
+// The text of a token returned by next() stays valid until the following call to next().
+class StreamLexer
+{
+public:
+    explicit StreamLexer(std::istream& input, size_t chunk_size = 64 * 1024)
+        : input(input), buffer(std::max<size_t>(chunk_size, 16)) {}
+
+    bool next(TokenView& token)
+    {
+        for(;;)
+        {
+            while(position != filled && detail::is_space(buffer[position]))
+                ++position;
+            if(position == filled && !refill())
+                return false;
+            if(detail::is_space(buffer[position]))
+                continue;
+
+            const char c = buffer[position];
+            Token::Type type;
+            if(detail::single_char_token(c, type))
+            {
+                token = TokenView{type, std::string_view{&buffer[position], 1}, 0};
+                ++position;
+                return true;
+            }
+            if(detail::is_digit(c))
+            {
+                std::string_view digits = scan(detail::is_digit);
+                token = TokenView{Token::integer, digits, detail::parse_integer(digits)};
+                return true;
+            }
+            if(detail::is_identifier_start(c))
+            {
+                token = TokenView{Token::identifier, scan(detail::is_identifier_char), 0};
+                return true;
+            }
+            detail::unexpected(c);
+        }
+    }
+
+private:
+    // Consumes the run of characters matching accept that starts at position.
+    std::string_view scan(bool (*accept)(char))
+    {
+        size_t start = position;
+        for(;;)
+        {
+            while(position != filled && accept(buffer[position]))
+                ++position;
+            if(position != filled)
+                break;
+            // the run may continue in the next chunk, keep its prefix
+            size_t kept = position - start;
+            bool more = refill(start);
+            start = 0;
+            position = kept;
+            if(!more)
+                break;
+        }
+        return std::string_view{&buffer[start], position - start};
+    }
+
+    // Reads the next chunk; bytes from keep_from onwards are moved to the front first.
+    bool refill(size_t keep_from = std::string::npos)
+    {
+        size_t kept = keep_from == std::string::npos ? 0 : filled - keep_from;
+        if(kept)
+        {
+            std::copy(buffer.begin() + keep_from, buffer.begin() + filled, buffer.begin());
+            // a literal longer than the chunk has no bounded size, grow to fit it
+            if(kept * 2 > buffer.size())
+                buffer.resize(buffer.size() * 2);
+        }
+        input.read(buffer.data() + kept, static_cast<std::streamsize>(buffer.size() - kept));
+        size_t read = static_cast<size_t>(input.gcount());
+        filled = kept + read;
+        position = 0;
+        return read != 0;
+    }
+
+    std::istream& input;
+    std::vector<char> buffer;
+    size_t position = 0;
+    size_t filled = 0;
+};
+
+// Read-only memory mapping of a whole file, meant to be lexed with lex_view().
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            throw std::runtime_error("cannot open " + path);
+
+        struct stat info{};
+        if(::fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            length = static_cast<size_t>(info.st_size);
+            void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(mapped == MAP_FAILED)
+            {
+                ::close(fd);
+                throw std::runtime_error("cannot map " + path);
+            }
+            address = static_cast<const char*>(mapped);
+            ::madvise(mapped, length, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if(address)
+            ::munmap(const_cast<char*>(address), length);
+    }
+
+    MappedFile(MappedFile const&) = delete;
+    void operator=(MappedFile const&) = delete;
+
+    std::string_view view() const { return {address, length}; }
+
+private:
+    const char* address = nullptr;
+    size_t length = 0;
+};
@@ -0,0 +1,103 @@
+/*
+ * Concurrent LRU cache
+ *
+ * A fixed-capacity cache from strings to values, split into independently locked shards
+ * so that threads looking up different keys rarely wait for each other.
+ * Each shard is a classic LRU: a list ordered from most to least recently used
+ * and a hash map from key to list node. The map keys are string_views into the
+ * strings stored in the list nodes, so a lookup never has to allocate a key.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template <typename Value>
+class ConcurrentLruCache
+{
+public:
+    explicit ConcurrentLruCache(std::size_t capacity, std::size_t shard_count = 16)
+        : shards(shard_count)
+    {
+        std::size_t per_shard = (capacity + shard_count - 1) / shard_count;
+        for(auto& shard: shards)
+            shard.capacity = per_shard ? per_shard : 1;
+    }
+
+    std::optional<Value> get(std::string_view key)
+    {
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock{shard.mutex};
+        auto it = shard.index.find(key);
+        if(it == shard.index.end())
+        {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        // move the entry to the front without reallocating it
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return it->second->second;
+    }
+
+    void put(std::string_view key, Value value)
+    {
+        Shard& shard = shard_for(key);
+        std::lock_guard<std::mutex> lock{shard.mutex};
+        auto it = shard.index.find(key);
+        if(it != shard.index.end())
+        {
+            it->second->second = std::move(value);
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            return;
+        }
+
+        if(shard.entries.size() == shard.capacity)
+        {
+            shard.index.erase(shard.entries.back().first);
+            shard.entries.pop_back();
+        }
+        shard.entries.emplace_front(std::string{key}, std::move(value));
+        // the view points into the list node, which never moves
+        shard.index.emplace(shard.entries.front().first, shard.entries.begin());
+    }
+
+    std::size_t hit_count() const { return hits.load(std::memory_order_relaxed); }
+    std::size_t miss_count() const { return misses.load(std::memory_order_relaxed); }
+
+    double hit_rate() const
+    {
+        std::size_t total = hit_count() + miss_count();
+        return total ? static_cast<double>(hit_count()) / total : 0.0;
+    }
+
+private:
+    typedef std::list<std::pair<std::string, Value>> Entries;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        Entries entries;
+        std::unordered_map<std::string_view, typename Entries::iterator> index;
+        std::size_t capacity = 1;
+    };
+
+    Shard& shard_for(std::string_view key)
+    {
+        return shards[std::hash<std::string_view>{}(key) % shards.size()];
+    }
+
+    std::vector<Shard> shards;
+    std::atomic<std::size_t> hits{0};
+    std::atomic<std::size_t> misses{0};
+};
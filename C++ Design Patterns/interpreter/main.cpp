@@ -7,168 +7,30 @@
  * In this example, the Token struct represents the tokens of the input string,
  * and the Element hierarchy (Integer, BinaryOperation)
  * represents the syntax tree that can be evaluated to produce a result.
+ * The parser builds the tree in a single pass over the tokens, honouring parentheses
+ * and operator precedence.
  */
 
 #include <iostream>
+#include <memory>
 #include <vector>
-#include <sstream>
-#include <boost/lexical_cast.hpp>
+#include "lexer.hpp"
+#include "parser.hpp"
 
-struct Token
-{
-    enum Type { integer, plus, minus, lparen, rparen} type;
-    std::string text;
-
-    Token(Type type, const std::string &text)
-        : type(type), text(text) {}
-
-    friend std::ostream& operator<<(std::ostream& os, const Token& obj)
-    {
-        os << "`" << obj.text << "`";
-        return os;
-    }
-};
-
-std::vector<Token> lex(const std::string& input)
-{
-    std::vector<Token> result;
-
-    for(size_t i = 0; i < input.size(); ++i)
-    {
-        switch(input[i])
-        {
-            case '+':
-                result.push_back(Token{Token::plus, "+"});
-                break;
-            case '-':
-                result.push_back(Token{Token::minus, "-"});
-                break;
-            case '(':
-                result.push_back(Token{Token::lparen, "("});
-                break;
-            case ')':
-                result.push_back(Token{Token::rparen, ")"});
-                break;
-            default:
-                std::ostringstream buffer;
-                buffer << input[i];
-                for(size_t j = i+1; j < input.size(); ++j)
-                {
-                    if(isdigit(input[j]))
-                    {
-                        buffer << input[j];
-                        ++i;
-                    }
-                    else
-                    {
-                        result.push_back(Token{Token::integer, buffer.str()});
-                        break;
-                    }
-                }
-        }
-    }
-
-    return result;
-}
-
-struct Element
-{
-    virtual int eval() const = 0;
-};
-
-struct Integer: Element
-{
-    int value;
-
-    Integer(int value)
-        : value(value) {}
-
-    int eval() const override
-    {
-        return value;
-    }
-};
-
-struct BinaryOperation: Element
-{
-    enum Type { addition, subtraction} type;
-    std::shared_ptr<Element> lhs, rhs;
-
-    int eval() const override
-    {
-        int left = lhs->eval();
-        int right = rhs->eval();
-
-        if(type == addition)
-            return left + right;
-        return left - right;
-    }
-};
-
-std::shared_ptr<Element> parse(const std::vector<Token>& tokens)
+int main()
 {
-    auto result = std::make_shared<BinaryOperation>();
-    bool have_lhs = false;
+    std::string input{"(13-4)-(12+1)*(2-(3-4))"};
 
-    for(size_t i = 0; i < tokens.size(); ++i)
+    auto tokens = lex(input);
+    for(auto& token: tokens)
     {
-        auto token = tokens[i];
-        switch(token.type)
-        {
-            case Token::integer:
-            {
-                int value = boost::lexical_cast<int>(token.text);
-                auto integer = std::make_shared<Integer>(value);
-
-                if(!have_lhs)
-                {
-                    result->lhs = integer;
-                    have_lhs = true;
-                }
-                else
-                {
-                    result->rhs = integer;
-                }
-            }
-            break;
-            case Token::plus:
-                result->type = BinaryOperation::addition;
-                break;
-            case Token::minus:
-                result->type = BinaryOperation::subtraction;
-                break;
-            case Token::lparen:
-            {
-                size_t j = i;
-                for(; j < tokens.size(); ++j)
-                    if(tokens[j].type == Token::rparen)
-                        break;
-                std::vector<Token> subexpression(&tokens[i+1], &tokens[j]);
-                auto element = parse(subexpression);
-                if(!have_lhs)
-                {
-                    result->lhs = element;
-                    have_lhs = true;
-                }
-                else
-                {
-                    result->rhs = element;
-                }
-                i = j;
-            }
-            break;
-        }
+        std::cout << token << " ";
     }
 
-    return result;
-};
-
-int main()
-{
-    std::string input{"(13-4)-(12+1)"};
+    std::cout << "\n" << std::endl;
 
-    auto tokens = lex(input);
-    for(auto& token: tokens)
+    // zero-copy tokens: views into input with integers already parsed
+    for(auto& token: lex_view(input))
     {
         std::cout << token << " ";
     }
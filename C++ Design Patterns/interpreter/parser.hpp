@@ -0,0 +1,262 @@
+/*
+ * Operator-precedence parser for the interpreter
+ *
+ * The parser reads the token array once, left to right, and never copies it.
+ * It keeps two explicit stacks, one of finished operands and one of pending operators
+ * and open parentheses (Dijkstra's shunting-yard algorithm). Whenever an operator
+ * arrives, every pending operator that binds at least as tightly is reduced first,
+ * which gives '*' and '/' precedence over '+' and '-' and makes all of them left-associative.
+ * Because the stacks live on the heap, the nesting depth is not limited by the call stack.
+ *
+ * Nodes are created through a Builder, so the same parser can produce different trees:
+ * the ElementBuilder below produces the Element hierarchy, other builders can
+ * allocate nodes elsewhere or compile them straight into another representation.
+ * ElementBuilder places its nodes in a NodeArena: a node costs a bump of a pointer instead
+ * of a heap allocation and a shared_ptr control block. Its operations are ArenaOperations,
+ * linked by plain pointers, and only the root handed out by parse() owns anything:
+ * the whole arena.
+ * A Builder provides a Node type and three factory functions:
+ *     Node integer(int value);
+ *     Node variable(std::string_view name);
+ *     Node binary(BinaryOperation::Type type, Node lhs, Node rhs);
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "element.hpp"
+#include "lexer.hpp"
+
+// Owns the nodes of the trees built by one ElementBuilder. Nodes are bump-allocated
+// from blocks and destroyed together with the arena.
+class NodeArena
+{
+public:
+    NodeArena() = default;
+
+    NodeArena(NodeArena const&) = delete;
+    void operator=(NodeArena const&) = delete;
+
+    ~NodeArena()
+    {
+        for(auto it = nodes.rbegin(); it != nodes.rend(); ++it)
+            (*it)->~Element();
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        void* memory = allocate(sizeof(T), alignof(T));
+        // so that recording the node cannot throw once it is constructed
+        if(nodes.size() == nodes.capacity())
+            nodes.reserve(nodes.size() * 2 + 64);
+        T* node = new(memory) T(std::forward<Args>(args)...);
+        nodes.push_back(node);
+        return node;
+    }
+
+private:
+    static constexpr std::size_t block_size = 4096;
+
+    void* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        std::size_t padding = (alignment - reinterpret_cast<std::uintptr_t>(next) % alignment) % alignment;
+        if(padding + bytes > left)
+        {
+            // blocks from new[] are aligned for any node
+            std::size_t size = std::max(bytes, block_size);
+            blocks.emplace_back(new char[size]);
+            next = blocks.back().get();
+            left = size;
+            padding = 0;
+        }
+        void* result = next + padding;
+        next += padding + bytes;
+        left -= padding + bytes;
+        return result;
+    }
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* next = nullptr;
+    std::size_t left = 0;
+    std::vector<Element*> nodes;
+};
+
+struct ElementBuilder
+{
+    typedef Element* Node;
+
+    std::shared_ptr<NodeArena> arena = std::make_shared<NodeArena>();
+    // one node per distinct name, so binding a value once updates every use
+    std::map<std::string, Variable*, std::less<>> variables;
+
+    Node integer(int value)
+    {
+        return arena->make<Integer>(value);
+    }
+
+    Node variable(std::string_view name)
+    {
+        auto it = variables.find(name);
+        if(it == variables.end())
+            it = variables.emplace(std::string{name}, arena->make<Variable>(std::string{name})).first;
+        return it->second;
+    }
+
+    Node binary(BinaryOperation::Type type, Node lhs, Node rhs)
+    {
+        return arena->make<ArenaOperation>(type, lhs, rhs);
+    }
+
+    // Binds name in every tree built so far; returns false if none of them uses it.
+    bool bind(std::string_view name, int value)
+    {
+        auto it = variables.find(name);
+        if(it == variables.end())
+            return false;
+        it->second->value = value;
+        return true;
+    }
+
+    // The tree rooted at node, which keeps the whole arena alive.
+    std::shared_ptr<Element> share(Node node) const
+    {
+        return std::shared_ptr<Element>(arena, node);
+    }
+};
+
+namespace detail
+{
+    inline int precedence(Token::Type type)
+    {
+        switch(type)
+        {
+            case Token::plus:
+            case Token::minus:
+                return 1;
+            case Token::times:
+            case Token::divide:
+                return 2;
+            default:
+                return 0;
+        }
+    }
+
+    inline BinaryOperation::Type operation(Token::Type type)
+    {
+        switch(type)
+        {
+            case Token::plus: return BinaryOperation::addition;
+            case Token::minus: return BinaryOperation::subtraction;
+            case Token::times: return BinaryOperation::multiplication;
+            default: return BinaryOperation::division;
+        }
+    }
+}
+
+template <typename Builder>
+typename Builder::Node parse(const std::vector<TokenView>& tokens, Builder& builder)
+{
+    typedef typename Builder::Node Node;
+
+    std::vector<Node> operands;
+    std::vector<Token::Type> operators;
+
+    auto reduce = [&]()
+    {
+        Node rhs = std::move(operands.back());
+        operands.pop_back();
+        Node lhs = std::move(operands.back());
+        operands.pop_back();
+        operands.push_back(builder.binary(detail::operation(operators.back()), std::move(lhs), std::move(rhs)));
+        operators.pop_back();
+    };
+
+    // true when the next token must start an operand: an integer, a variable or a '('
+    bool expect_operand = true;
+
+    for(auto& token: tokens)
+    {
+        switch(token.type)
+        {
+            case Token::integer:
+                if(!expect_operand)
+                    throw std::invalid_argument("missing operator before " + std::string{token.text});
+                operands.push_back(builder.integer(token.value));
+                expect_operand = false;
+                break;
+            case Token::identifier:
+                if(!expect_operand)
+                    throw std::invalid_argument("missing operator before " + std::string{token.text});
+                operands.push_back(builder.variable(token.text));
+                expect_operand = false;
+                break;
+            case Token::lparen:
+                if(!expect_operand)
+                    throw std::invalid_argument("missing operator before (");
+                operators.push_back(Token::lparen);
+                break;
+            case Token::rparen:
+                if(expect_operand)
+                    throw std::invalid_argument("missing operand before )");
+                while(!operators.empty() && operators.back() != Token::lparen)
+                    reduce();
+                if(operators.empty())
+                    throw std::invalid_argument("unbalanced )");
+                operators.pop_back();
+                break;
+            default:
+                if(expect_operand)
+                    throw std::invalid_argument("missing operand before " + std::string{token.text});
+                while(!operators.empty() && detail::precedence(operators.back()) >= detail::precedence(token.type))
+                    reduce();
+                operators.push_back(token.type);
+                expect_operand = true;
+                break;
+        }
+    }
+
+    if(expect_operand)
+        throw std::invalid_argument(tokens.empty() ? "empty expression" : "missing operand at end of expression");
+    while(!operators.empty())
+    {
+        if(operators.back() == Token::lparen)
+            throw std::invalid_argument("unbalanced (");
+        reduce();
+    }
+
+    return std::move(operands.back());
+}
+
+// The variables of the tree are unbound, so evaluating one of them throws; parse with
+// an ElementBuilder of your own and bind() them to give them values.
+inline std::shared_ptr<Element> parse(const std::vector<TokenView>& tokens)
+{
+    ElementBuilder builder;
+    return builder.share(parse(tokens, builder));
+}
+
+// Parses the tokens produced by lex(); the views point into the tokens' text.
+inline std::shared_ptr<Element> parse(const std::vector<Token>& tokens)
+{
+    std::vector<TokenView> views;
+    views.reserve(tokens.size());
+    for(auto& token: tokens)
+    {
+        int value = token.type == Token::integer ? detail::parse_integer(token.text) : 0;
+        views.push_back(TokenView{token.type, token.text, value});
+    }
+    return parse(views);
+}
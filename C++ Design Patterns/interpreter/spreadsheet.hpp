@@ -0,0 +1,224 @@
+/*
+ * Incremental evaluation with dependency tracking
+ *
+ * A Spreadsheet keeps many formulas over a set of named input variables up to date.
+ * Formulas are parsed straight into a dependency graph: every constant, variable and
+ * operation is a node, and structurally identical subexpressions are stored only once,
+ * so a subexpression shared by many formulas is also computed only once.
+ * Every node caches its value and knows the nodes that depend on it.
+ *
+ * When a variable changes, only its dependents are marked dirty. recalculate() recomputes
+ * dirty nodes in order of their height (the length of the longest path down to a leaf),
+ * which is a topological order, since a node is always higher than its operands.
+ * A node whose value does not change stops the propagation there.
+ * Like an unbound Variable, an input that was never set() makes the formulas using it throw.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "element.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+
+class Spreadsheet
+{
+public:
+    typedef std::uint32_t Formula;
+
+    // Parses text and returns a handle to its value; identical formulas share a handle.
+    Formula add_formula(std::string_view text)
+    {
+        Builder builder{*this};
+        return parse(lex_view(text), builder);
+    }
+
+    // Assigns an input variable, creating it if no formula uses it yet.
+    void set(std::string_view name, int value)
+    {
+        Node& node = nodes[variable(name)];
+        if(node.value == value && node.failure == Node::none)
+            return;
+        node.value = value;
+        node.failure = Node::none;
+        mark_dependents(node);
+    }
+
+    // Brings every formula affected by set() up to date.
+    void recalculate()
+    {
+        recomputed = 0;
+        for(std::size_t height = 1; height < dirty.size(); ++height)
+        {
+            // operands are lower than the nodes using them, so a bucket
+            // only gains entries while lower buckets are being processed
+            for(std::size_t i = 0; i < dirty[height].size(); ++i)
+            {
+                Node& node = nodes[dirty[height][i]];
+                node.queued = false;
+                if(update(node))
+                    mark_dependents(node);
+                ++recomputed;
+            }
+            dirty[height].clear();
+        }
+    }
+
+    int value(Formula formula)
+    {
+        recalculate();
+        const Node& node = nodes[formula];
+        if(node.failure == Node::unbound)
+            throw std::invalid_argument("formula uses a variable that was never set");
+        if(node.failure == Node::division_by_zero)
+            throw std::domain_error("division by zero");
+        return node.value;
+    }
+
+    // number of distinct nodes in the graph
+    std::size_t size() const { return nodes.size(); }
+
+    // number of nodes the last recalculate() had to recompute
+    std::size_t last_recomputed() const { return recomputed; }
+
+private:
+    struct Node
+    {
+        enum Kind : std::uint8_t { constant, variable, operation } kind;
+        BinaryOperation::Type type;
+        std::uint32_t lhs, rhs;
+        std::uint32_t height;
+        int value;
+        // why the value could not be computed: an input that was never set(),
+        // or a division by zero; operations inherit the failure of their operands
+        enum Failure : std::uint8_t { none, unbound, division_by_zero } failure;
+        bool queued;
+        std::vector<std::uint32_t> dependents;
+    };
+
+    struct Key
+    {
+        Node::Kind kind;
+        BinaryOperation::Type type;
+        std::uint32_t lhs, rhs;
+        int value;
+
+        bool operator==(const Key& other) const
+        {
+            return kind == other.kind && type == other.type && lhs == other.lhs
+                && rhs == other.rhs && value == other.value;
+        }
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& key) const
+        {
+            std::uint64_t children = (std::uint64_t{key.lhs} << 32) | key.rhs;
+            std::size_t seed = std::hash<std::uint64_t>{}(children);
+            seed ^= std::hash<int>{}(key.value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            return seed ^ (key.kind << 4 | key.type);
+        }
+    };
+
+    struct Builder
+    {
+        typedef std::uint32_t Node;
+        Spreadsheet& sheet;
+
+        Node integer(int value)
+        {
+            return sheet.intern(Key{Spreadsheet::Node::constant, BinaryOperation::addition, 0, 0, value});
+        }
+
+        Node variable(std::string_view name)
+        {
+            return sheet.variable(name);
+        }
+
+        Node binary(BinaryOperation::Type type, Node lhs, Node rhs)
+        {
+            return sheet.intern(Key{Spreadsheet::Node::operation, type, lhs, rhs, 0});
+        }
+    };
+
+    std::uint32_t variable(std::string_view name)
+    {
+        auto it = variables.find(name);
+        if(it != variables.end())
+            return it->second;
+
+        auto id = static_cast<std::uint32_t>(nodes.size());
+        nodes.push_back(Node{Node::variable, BinaryOperation::addition, 0, 0, 0, 0, Node::unbound, false, {}});
+        variables.emplace(std::string{name}, id);
+        return id;
+    }
+
+    std::uint32_t intern(const Key& key)
+    {
+        auto it = interned.find(key);
+        if(it != interned.end())
+            return it->second;
+
+        auto id = static_cast<std::uint32_t>(nodes.size());
+        Node node{key.kind, key.type, key.lhs, key.rhs, 0, key.value, Node::none, false, {}};
+        if(key.kind == Node::operation)
+        {
+            node.height = std::max(nodes[key.lhs].height, nodes[key.rhs].height) + 1;
+            update(node);
+            nodes[key.lhs].dependents.push_back(id);
+            if(key.rhs != key.lhs)
+                nodes[key.rhs].dependents.push_back(id);
+        }
+        nodes.push_back(std::move(node));
+        interned.emplace(key, id);
+        return id;
+    }
+
+    // Recomputes an operation from its operands, returns true if the result changed.
+    bool update(Node& node)
+    {
+        const Node& left = nodes[node.lhs];
+        const Node& right = nodes[node.rhs];
+
+        Node::Failure failure = left.failure ? left.failure : right.failure;
+        if(!failure && node.type == BinaryOperation::division && right.value == 0)
+            failure = Node::division_by_zero;
+        int value = failure ? 0 : BinaryOperation::apply(node.type, left.value, right.value);
+
+        bool changed = value != node.value || failure != node.failure;
+        node.value = value;
+        node.failure = failure;
+        return changed;
+    }
+
+    void mark_dependents(const Node& node)
+    {
+        for(auto id: node.dependents)
+        {
+            Node& dependent = nodes[id];
+            if(dependent.queued)
+                continue;
+            dependent.queued = true;
+            if(dirty.size() <= dependent.height)
+                dirty.resize(dependent.height + 1);
+            dirty[dependent.height].push_back(id);
+        }
+    }
+
+    std::vector<Node> nodes;
+    std::unordered_map<Key, std::uint32_t, KeyHash> interned;
+    std::map<std::string, std::uint32_t, std::less<>> variables;
+    // dirty node ids, bucketed by height
+    std::vector<std::vector<std::uint32_t>> dirty;
+    std::size_t recomputed = 0;
+};
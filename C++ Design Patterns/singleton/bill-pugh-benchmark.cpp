@@ -0,0 +1,99 @@
+/**
+ * Benchmark of the reference-returning BillPughSingleton against copy-per-call access
+ *
+ * The old instance() returned the singleton by value, so every access copied the whole
+ * std::map and cost O(n) in the number of entries. CopyingSingleton reproduces that
+ * behaviour; it is compared with BillPughSingleton::instance().get() for stores of
+ * growing size, then the new store is read and written from several threads.
+ * Usage: bill-pugh-benchmark [threads]
+ */
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bill-pugh-singleton.hpp"
+
+// the old behaviour: instance() copies everything, get_value() inserts on a miss
+struct CopyingSingleton
+{
+    static CopyingSingleton instance() { return unique_instance; }
+
+    std::string get_value(std::string key) { return database[key]; }
+
+    std::map<std::string, std::string> database;
+    static CopyingSingleton unique_instance;
+};
+
+CopyingSingleton CopyingSingleton::unique_instance;
+
+template <typename F>
+double measure(int iterations, F&& f)
+{
+    size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+        sink += f(i);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    if (sink == 42)
+        std::cout << "";
+    return elapsed.count() / iterations;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned threads = argc > 1 ? static_cast<unsigned>(std::stoul(argv[1])) : std::thread::hardware_concurrency();
+    BillPughSingleton& store = BillPughSingleton::instance();
+
+    for (int entries : {10, 100, 1000, 10000})
+    {
+        for (int i = static_cast<int>(store.size()); i < entries; ++i)
+        {
+            std::string key = "key" + std::to_string(i);
+            store.put(key, "value" + std::to_string(i));
+            CopyingSingleton::unique_instance.database[key] = "value" + std::to_string(i);
+        }
+
+        std::vector<std::string> keys;
+        for (int i = 0; i < 1000; ++i)
+            keys.push_back("key" + std::to_string(i * 7919 % entries));
+
+        int iterations = entries >= 10000 ? 2000 : 20000;
+        double copying = measure(iterations, [&](int i)
+        {
+            return CopyingSingleton::instance().get_value(keys[i % keys.size()]).size();
+        });
+        double by_reference = measure(iterations, [&](int i)
+        {
+            return BillPughSingleton::instance().get(keys[i % keys.size()])->size();
+        });
+        std::cout << entries << " entries: copy per call " << copying << " ns, by reference "
+                  << by_reference << " ns (" << copying / by_reference << "x)" << std::endl;
+    }
+
+    // 90% reads, 10% writes on every thread
+    const int operations = 200000;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t)
+        workers.emplace_back([t, &store]
+        {
+            for (int i = 0; i < operations; ++i)
+            {
+                std::string key = "key" + std::to_string((i * 31 + t) % 10000);
+                if (i % 10 == 0)
+                    store.put(key, "updated");
+                else
+                    store.get(key);
+            }
+        });
+    for (auto& worker : workers)
+        worker.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << threads << " threads: " << threads * operations / elapsed.count() / 1e6
+              << " million operations per second" << std::endl;
+    return 0;
+}
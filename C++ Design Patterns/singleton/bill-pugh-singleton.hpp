@@ -0,0 +1,118 @@
+/**
+ * Example of the Bill Pugh singleton implementation
+ * Here, an inner class is used to create the singleton instance using a static method
+ * and is one of the most widely used variants for implementing the singleton pattern
+ *
+ * instance() returns a reference: the singleton cannot be copied, so every caller
+ * shares the one store instead of copying all of it on each access.
+ * The store is a key/value map that many threads can use at once. The keys are
+ * spread over 64 stripes, each a hash map with its own reader/writer lock, so:
+ *  - get() only takes a shared lock on one stripe, and readers never block each other;
+ *  - put() and erase() lock one stripe exclusively, and only block the readers and
+ *    writers of that stripe.
+ * Lookups take a string_view and never insert anything.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct BillPughSingleton
+{
+    static BillPughSingleton& instance()
+    {
+        return InnerBillPughSingleton::unique_instance;
+    }
+
+    std::optional<std::string> get(std::string_view key) const
+    {
+        const Stripe& stripe = stripe_of(key);
+        std::shared_lock<std::shared_mutex> lock{stripe.mutex};
+        auto it = stripe.values.find(key);
+        if (it == stripe.values.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    // The value of key, or an empty string if there is none.
+    std::string get_value(std::string_view key) const
+    {
+        return get(key).value_or(std::string{});
+    }
+
+    void put(std::string_view key, std::string value)
+    {
+        Stripe& stripe = stripe_of(key);
+        std::unique_lock<std::shared_mutex> lock{stripe.mutex};
+        auto it = stripe.values.find(key);
+        if (it != stripe.values.end())
+            it->second = std::move(value);
+        else
+            stripe.values.emplace(std::string{key}, std::move(value));
+    }
+
+    // Returns true if key was there.
+    bool erase(std::string_view key)
+    {
+        Stripe& stripe = stripe_of(key);
+        std::unique_lock<std::shared_mutex> lock{stripe.mutex};
+        auto it = stripe.values.find(key);
+        if (it == stripe.values.end())
+            return false;
+        stripe.values.erase(it);
+        return true;
+    }
+
+    size_t size() const
+    {
+        size_t total = 0;
+        for (auto& stripe : stripes)
+        {
+            std::shared_lock<std::shared_mutex> lock{stripe.mutex};
+            total += stripe.values.size();
+        }
+        return total;
+    }
+
+    BillPughSingleton(BillPughSingleton const&) = delete;
+    void operator=(BillPughSingleton const&) = delete;
+
+private:
+    static constexpr size_t stripe_count = 64;
+
+    // lets the maps be searched with a string_view
+    struct KeyHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+
+    struct alignas(64) Stripe
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, std::string, KeyHash, std::equal_to<>> values;
+    };
+
+    Stripe& stripe_of(std::string_view key) { return stripes[KeyHash{}(key) % stripe_count]; }
+    const Stripe& stripe_of(std::string_view key) const { return stripes[KeyHash{}(key) % stripe_count]; }
+
+    Stripe stripes[stripe_count];
+
+    BillPughSingleton() {}
+
+    struct InnerBillPughSingleton
+    {
+        static BillPughSingleton unique_instance;
+    };
+};
+
+// the definition the instance was missing; it can call the private constructor
+// because it is a member of the nested class
+inline BillPughSingleton BillPughSingleton::InnerBillPughSingleton::unique_instance;
@@ -0,0 +1,240 @@
+/**
+ * Caching decorator for slow databases
+ *
+ * CachingDatabase implements Database on top of another Database and remembers
+ * the answers, so that a backend that is expensive to query is asked about each
+ * city only once while the city stays in the cache:
+ *  - the cache is split into shards by the hash of the name, each with its own mutex,
+ *    so threads looking up different cities rarely wait for each other;
+ *  - each shard holds at most capacity / shard count entries and evicts with CLOCK:
+ *    a hit sets the entry's reference bit, and the clock hand skips (and clears)
+ *    referenced entries, so recently used cities survive a scan;
+ *  - misses are cached too, so unknown cities do not reach the backend again;
+ *  - when several threads miss on the same city at the same time, only the first one
+ *    queries the backend and the others wait for its answer (request coalescing).
+ * The backend is queried without holding any lock. If it throws, the waiting threads
+ * get the same exception and nothing is cached.
+ * SlowDatabase is a backend with a fixed latency per query, for tests and benchmarks.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "database.hpp"
+
+struct CacheStats
+{
+    uint64_t hits = 0;
+    // hits on a cached "no such city"
+    uint64_t negative_hits = 0;
+    // lookups that queried the backend
+    uint64_t misses = 0;
+    // lookups that waited for another thread's query instead
+    uint64_t coalesced = 0;
+    uint64_t evictions = 0;
+
+    // share of lookups answered from the cache, cached misses included
+    double hit_rate() const
+    {
+        uint64_t total = hits + negative_hits + misses + coalesced;
+        return total ? static_cast<double>(hits + negative_hits) / total : 0.0;
+    }
+};
+
+class CachingDatabase: public Database
+{
+public:
+    CachingDatabase(const Database& backend, size_t capacity)
+        : backend{backend}, shard_capacity{std::max<size_t>(1, capacity / shard_count)} {}
+
+    CachingDatabase(CachingDatabase const&) = delete;
+    void operator=(CachingDatabase const&) = delete;
+
+    std::optional<int> find(std::string_view name) const override
+    {
+        size_t hash = std::hash<std::string_view>{}(name);
+        Shard& shard = shards[hash % shard_count];
+
+        std::shared_future<std::optional<int>> pending;
+        std::promise<std::optional<int>> promise;
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock{shard.mutex};
+            if (auto it = shard.index.find(name); it != shard.index.end())
+            {
+                Entry& entry = shard.entries[it->second];
+                entry.referenced = true;
+                (entry.value ? hits : negative_hits).fetch_add(1, std::memory_order_relaxed);
+                return entry.value;
+            }
+            if (auto it = shard.in_flight.find(name); it != shard.in_flight.end())
+                pending = it->second;
+            else
+                shard.in_flight.emplace(std::string{name}, promise.get_future().share());
+            generation = shard.generation;
+        }
+
+        if (pending.valid())
+        {
+            coalesced.fetch_add(1, std::memory_order_relaxed);
+            return pending.get();
+        }
+
+        misses.fetch_add(1, std::memory_order_relaxed);
+        std::optional<int> value;
+        try
+        {
+            value = backend.find(name);
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> lock{shard.mutex};
+                if (shard.generation == generation)
+                    shard.in_flight.erase(shard.in_flight.find(name));
+            }
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+        {
+            std::lock_guard<std::mutex> lock{shard.mutex};
+            // after a clear() the answer may predate the change that caused it, so it is
+            // only handed to the callers already waiting, and the name's in-flight entry,
+            // if any, belongs to a newer query
+            if (shard.generation == generation)
+            {
+                insert(shard, name, value);
+                shard.in_flight.erase(shard.in_flight.find(name));
+            }
+        }
+        promise.set_value(value);
+        return value;
+    }
+
+    // Forgets every cached answer, e.g. after the backend's data changed. Queries already
+    // in flight are not cached when they complete, and later lookups query the backend
+    // again rather than wait for them.
+    void clear()
+    {
+        for (auto& shard : shards)
+        {
+            std::lock_guard<std::mutex> lock{shard.mutex};
+            shard.entries.clear();
+            shard.index.clear();
+            shard.in_flight.clear();
+            ++shard.generation;
+            shard.hand = 0;
+        }
+    }
+
+    CacheStats stats() const
+    {
+        CacheStats result;
+        result.hits = hits.load(std::memory_order_relaxed);
+        result.negative_hits = negative_hits.load(std::memory_order_relaxed);
+        result.misses = misses.load(std::memory_order_relaxed);
+        result.coalesced = coalesced.load(std::memory_order_relaxed);
+        result.evictions = evictions.load(std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    static constexpr size_t shard_count = 16;
+
+    // lets the maps be searched with a string_view
+    struct NameHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+    };
+
+    struct Entry
+    {
+        std::string name;
+        std::optional<int> value;
+        bool referenced;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::vector<Entry> entries;
+        // name -> position in entries
+        std::unordered_map<std::string, size_t, NameHash, std::equal_to<>> index;
+        std::unordered_map<std::string, std::shared_future<std::optional<int>>, NameHash, std::equal_to<>> in_flight;
+        // CLOCK hand, the next entry considered for eviction
+        size_t hand = 0;
+        // bumped by clear(), so that queries started before it are not cached
+        uint64_t generation = 0;
+    };
+
+    // Called with the shard locked.
+    void insert(Shard& shard, std::string_view name, std::optional<int> value) const
+    {
+        if (shard.entries.size() < shard_capacity)
+        {
+            shard.index.emplace(std::string{name}, shard.entries.size());
+            shard.entries.push_back({std::string{name}, value, false});
+            return;
+        }
+
+        // second chance: referenced entries lose their bit and are passed over once
+        while (shard.entries[shard.hand].referenced)
+        {
+            shard.entries[shard.hand].referenced = false;
+            shard.hand = (shard.hand + 1) % shard.entries.size();
+        }
+        Entry& victim = shard.entries[shard.hand];
+        shard.index.erase(shard.index.find(victim.name));
+        victim.name.assign(name);
+        victim.value = value;
+        shard.index.emplace(victim.name, shard.hand);
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const Database& backend;
+    size_t shard_capacity;
+    mutable Shard shards[shard_count];
+    mutable std::atomic<uint64_t> hits{0}, negative_hits{0}, misses{0}, coalesced{0}, evictions{0};
+};
+
+// A backend that takes latency to answer every query, and counts the queries.
+class SlowDatabase: public Database
+{
+public:
+    SlowDatabase(std::map<std::string, int, std::less<>> capitals, std::chrono::microseconds latency)
+        : capitals{std::move(capitals)}, latency{latency} {}
+
+    std::optional<int> find(std::string_view name) const override
+    {
+        queries.fetch_add(1, std::memory_order_relaxed);
+        std::this_thread::sleep_for(latency);
+        auto it = capitals.find(name);
+        if (it == capitals.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    uint64_t query_count() const { return queries.load(std::memory_order_relaxed); }
+
+private:
+    const std::map<std::string, int, std::less<>> capitals;
+    std::chrono::microseconds latency;
+    mutable std::atomic<uint64_t> queries{0};
+};
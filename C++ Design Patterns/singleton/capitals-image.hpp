@@ -0,0 +1,280 @@
+/**
+ * Compiled binary image of the capitals database
+ *
+ * compile-capitals turns capitals.txt into a file that is used exactly as it is laid out,
+ * so opening it is one mmap, with no parsing and no allocation, and every process on
+ * the host that opens it shares one copy in the page cache:
+ *
+ *     header          magic, version, byte order mark, count, bucket count, blob size, seed
+ *     displacements   two uint32 per bucket, the minimal perfect hash
+ *     keys            one uint64 per slot: offset of the name in the blob (low 40 bits)
+ *                     and its length (high 24 bits)
+ *     values          one int32 population per slot
+ *     order           one uint32 per slot: the slots sorted by name, so that the prefix
+ *                     index can be built without sorting
+ *     blob            the names, back to back
+ *
+ * The perfect hash is CHD ("hash, displace and compress", without the compression):
+ * the names are split into buckets of about four by their hash, and each bucket gets
+ * a displacement pair (d0, d1) chosen when compiling so that
+ *     slot = (h1 + d0 * h2 + d1) mod count
+ * sends every name of the bucket to its own slot. Every name therefore lands in one
+ * of exactly count slots with no collisions, and a lookup is two array reads and
+ * one name comparison, which rejects names that are not in the image.
+ * The image uses the byte order of the host that compiled it.
+ * Opening an image checks its header against the file's length, every name against
+ * the blob and every entry of order against count, and throws if anything is out of
+ * place, so a truncated or corrupt image is rejected before it is read.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "capitals-loader.hpp"
+
+struct CapitalsImageHeader
+{
+    char magic[8];
+    uint32_t version;
+    // capitals_byte_order as written by the compiling host
+    uint32_t byte_order;
+    uint64_t count;
+    uint64_t bucket_count;
+    uint64_t blob_size;
+    // chosen by the compiler, see chd::seeded()
+    uint64_t seed;
+};
+
+inline constexpr char capitals_magic[8] = {'C', 'A', 'P', 'I', 'T', 'A', 'L', 'S'};
+inline constexpr uint32_t capitals_byte_order = 0x01020304;
+inline constexpr uint32_t capitals_version = 2;
+
+namespace chd
+{
+    // average number of names per bucket
+    inline constexpr uint64_t bucket_size = 4;
+
+    inline uint64_t mix(uint64_t hash)
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    // Two names of one bucket with the same h1 and h2 can never be separated;
+    // the compiler then starts over with another seed.
+    inline uint64_t seeded(uint64_t hash, uint64_t seed) { return mix(hash + seed * 0x9e3779b97f4a7c15ull); }
+
+    // all three take a seeded hash
+    inline uint64_t bucket(uint64_t hash, uint64_t bucket_count) { return (hash >> 32) % bucket_count; }
+    inline uint64_t h1(uint64_t hash, uint64_t count) { return hash % count; }
+    inline uint64_t h2(uint64_t hash, uint64_t count) { return mix(hash) % count; }
+
+    inline uint64_t slot(uint64_t hash, uint64_t count, uint32_t d0, uint32_t d1)
+    {
+        return (h1(hash, count) + uint64_t{d0} * h2(hash, count) + d1) % count;
+    }
+}
+
+class CapitalsImage
+{
+public:
+    explicit CapitalsImage(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("cannot open " + path);
+        struct stat info{};
+        if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(CapitalsImageHeader))
+        {
+            ::close(fd);
+            throw std::runtime_error(path + " is not a capitals image");
+        }
+        length = static_cast<size_t>(info.st_size);
+        void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            throw std::runtime_error("cannot map " + path);
+        address = static_cast<const char*>(mapped);
+
+        auto header = reinterpret_cast<const CapitalsImageHeader*>(address);
+        if (!valid(*header, length - sizeof(CapitalsImageHeader)))
+        {
+            unmap();
+            throw std::runtime_error(path + " is not a capitals image");
+        }
+        count = header->count;
+        bucket_count = header->bucket_count;
+        seed = header->seed;
+        displacements = reinterpret_cast<const uint32_t*>(address + sizeof(CapitalsImageHeader));
+        keys = reinterpret_cast<const uint64_t*>(displacements + 2 * bucket_count);
+        values = reinterpret_cast<const int32_t*>(keys + count);
+        order = reinterpret_cast<const uint32_t*>(values + count);
+        blob = reinterpret_cast<const char*>(order + count);
+
+        // every name must lie inside the blob and every entry of order name a slot;
+        // this reads the keys and the order once, but allocates nothing
+        for (uint64_t s = 0; s < count; ++s)
+        {
+            uint64_t offset = keys[s] & ((uint64_t{1} << 40) - 1), size = keys[s] >> 40;
+            if (offset > header->blob_size || size > header->blob_size - offset || order[s] >= count)
+            {
+                unmap();
+                throw std::runtime_error(path + " is a corrupt capitals image");
+            }
+        }
+    }
+
+    ~CapitalsImage() { unmap(); }
+
+    CapitalsImage(CapitalsImage&& other) noexcept { *this = std::move(other); }
+
+    CapitalsImage& operator=(CapitalsImage&& other) noexcept
+    {
+        std::swap(address, other.address);
+        std::swap(length, other.length);
+        std::swap(count, other.count);
+        std::swap(bucket_count, other.bucket_count);
+        std::swap(seed, other.seed);
+        std::swap(displacements, other.displacements);
+        std::swap(keys, other.keys);
+        std::swap(values, other.values);
+        std::swap(order, other.order);
+        std::swap(blob, other.blob);
+        return *this;
+    }
+
+    std::optional<int> find(std::string_view name) const
+    {
+        if (!count)
+            return std::nullopt;
+        return find(name, chd::seeded(hash_capital(name), seed));
+    }
+
+    // Same contract as CapitalsTable::total_population(), with the same prefetching:
+    // displacements first, then the key and value of each slot, then the comparisons.
+    long long total_population(std::span<const std::string_view> names) const
+    {
+        if (!count)
+            return 0;
+        constexpr size_t group = 16;
+        uint64_t hashes[group];
+        long long total = 0;
+        for (size_t start = 0; start < names.size(); start += group)
+        {
+            size_t n = std::min(group, names.size() - start);
+            for (size_t i = 0; i < n; ++i)
+            {
+                hashes[i] = chd::seeded(hash_capital(names[start + i]), seed);
+                __builtin_prefetch(&displacements[2 * chd::bucket(hashes[i], bucket_count)]);
+            }
+            for (size_t i = 0; i < n; ++i)
+            {
+                uint64_t s = slot_of(hashes[i]);
+                __builtin_prefetch(&keys[s]);
+                __builtin_prefetch(&values[s]);
+            }
+            for (size_t i = 0; i < n; ++i)
+                if (auto population = find(names[start + i], hashes[i]))
+                    total += *population;
+        }
+        return total;
+    }
+
+    size_t size() const { return count; }
+
+    // Calls f(name, population) for every name, in slot order.
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        for (uint64_t s = 0; s < count; ++s)
+            f(name_at(s), values[s]);
+    }
+
+    // Calls f(name, population) for every name, in name order.
+    template <typename F>
+    void for_each_by_name(F&& f) const
+    {
+        for (uint64_t i = 0; i < count; ++i)
+            f(name_at(order[i]), values[order[i]]);
+    }
+
+    size_t mapped_bytes() const { return length; }
+
+private:
+    // Checks the header against the bytes that follow it, without overflowing on
+    // a corrupt header.
+    static bool valid(const CapitalsImageHeader& header, uint64_t available)
+    {
+        if (std::memcmp(header.magic, capitals_magic, sizeof capitals_magic) != 0 || header.version != capitals_version
+            || header.byte_order != capitals_byte_order)
+            return false;
+        // names are hashed into buckets, so there must be some
+        if (header.count != 0 && header.bucket_count == 0)
+            return false;
+        if (header.bucket_count > available / (2 * sizeof(uint32_t)))
+            return false;
+        available -= header.bucket_count * 2 * sizeof(uint32_t);
+        // a key, a value and an entry of order per slot
+        constexpr uint64_t slot_bytes = sizeof(uint64_t) + sizeof(int32_t) + sizeof(uint32_t);
+        if (header.count > available / slot_bytes)
+            return false;
+        available -= header.count * slot_bytes;
+        return header.blob_size == available;
+    }
+
+    // hash is seeded
+    uint64_t slot_of(uint64_t hash) const
+    {
+        const uint32_t* d = displacements + 2 * chd::bucket(hash, bucket_count);
+        return chd::slot(hash, count, d[0], d[1]);
+    }
+
+    std::string_view name_at(uint64_t s) const
+    {
+        return {blob + (keys[s] & ((uint64_t{1} << 40) - 1)), static_cast<size_t>(keys[s] >> 40)};
+    }
+
+    // hash is seeded
+    std::optional<int> find(std::string_view name, uint64_t hash) const
+    {
+        uint64_t s = slot_of(hash);
+        if (name_at(s) != name)
+            return std::nullopt;
+        return values[s];
+    }
+
+    void unmap()
+    {
+        if (address)
+            ::munmap(const_cast<char*>(address), length);
+        address = nullptr;
+    }
+
+    const char* address = nullptr;
+    size_t length = 0;
+    uint64_t count = 0;
+    uint64_t bucket_count = 0;
+    uint64_t seed = 0;
+    const uint32_t* displacements = nullptr;
+    const uint64_t* keys = nullptr;
+    const int32_t* values = nullptr;
+    const uint32_t* order = nullptr;
+    const char* blob = nullptr;
+};
@@ -0,0 +1,458 @@
+/**
+ * Fast loader for the capitals database
+ *
+ * capitals.txt holds one record per two lines: a city name, then its population.
+ * Reading it with std::getline, boost::lexical_cast and a std::map costs two string
+ * allocations and a tree insertion per record, which dominates startup on big files.
+ *
+ * CapitalsTable::load() maps the file instead and parses it in parallel:
+ *  - the file is split into one chunk per thread; a chunk starts at the beginning
+ *    of a line, and if that line is all digits it is the population of the previous
+ *    record, so it is skipped too. Every chunk therefore starts on a record boundary;
+ *  - each thread scans its chunk in place, copying the names into a blob of its own
+ *    and parsing the populations by hand;
+ *  - the blobs are concatenated into one, and the hash index is filled in parallel:
+ *    the index is split into regions by the top bits of the hash, the entries are
+ *    grouped by region in one pass, and each thread fills one region from its group.
+ * The result is a flat open-addressing hash table. As with the old std::map, a name
+ * that appears twice keeps the population of its last record.
+ * total_population() answers a whole batch of lookups with software prefetching.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Hashes eight bytes at a time; only meant for in-memory tables on one host.
+inline uint64_t hash_capital(std::string_view name)
+{
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ name.size();
+    size_t i = 0;
+    for (; i + 8 <= name.size(); i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, name.data() + i, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, name.data() + i, name.size() - i);
+    hash = (hash ^ tail) * 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 29;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+namespace detail
+{
+    class MappedText
+    {
+    public:
+        explicit MappedText(const std::string& path)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("cannot open " + path);
+            struct stat info{};
+            if (::fstat(fd, &info) == 0 && info.st_size > 0)
+            {
+                length = static_cast<size_t>(info.st_size);
+                void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped == MAP_FAILED)
+                {
+                    ::close(fd);
+                    throw std::runtime_error("cannot map " + path);
+                }
+                address = static_cast<const char*>(mapped);
+                ::madvise(mapped, length, MADV_SEQUENTIAL);
+            }
+            ::close(fd);
+        }
+
+        ~MappedText()
+        {
+            if (address)
+                ::munmap(const_cast<char*>(address), length);
+        }
+
+        MappedText(MappedText const&) = delete;
+        void operator=(MappedText const&) = delete;
+
+        std::string_view view() const { return {address, length}; }
+
+    private:
+        const char* address = nullptr;
+        size_t length = 0;
+    };
+
+    // Removes and returns the first line of text, without its line ending.
+    inline std::string_view next_line(std::string_view& text)
+    {
+        size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        return line;
+    }
+
+    inline bool all_digits(std::string_view line)
+    {
+        if (line.empty())
+            return false;
+        for (char c : line)
+            if (c < '0' || c > '9')
+                return false;
+        return true;
+    }
+
+    inline int parse_population(std::string_view line, std::string_view name)
+    {
+        if (!all_digits(line))
+            throw std::runtime_error("bad population for " + std::string{name} + ": " + std::string{line});
+        int64_t value = 0;
+        for (char c : line)
+        {
+            value = value * 10 + (c - '0');
+            if (value > INT32_MAX)
+                throw std::runtime_error("population of " + std::string{name} + " is out of range");
+        }
+        return static_cast<int>(value);
+    }
+
+    // Offset of the first record that starts at or after position.
+    inline size_t record_start(std::string_view text, size_t position)
+    {
+        if (position == 0 || position >= text.size())
+            return std::min(position, text.size());
+        size_t start = text.find('\n', position - 1);
+        if (start == std::string_view::npos)
+            return text.size();
+        std::string_view rest = text.substr(start + 1);
+        std::string_view line = next_line(rest);
+        return all_digits(line) ? text.size() - rest.size() : start + 1;
+    }
+
+    // Runs step(i) for i in [0, count), one thread each, and rethrows the first error.
+    template <typename Step>
+    void in_parallel(size_t count, Step&& step)
+    {
+        std::vector<std::exception_ptr> errors(count);
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < count; ++i)
+            workers.emplace_back([&, i]
+            {
+                try
+                {
+                    step(i);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            });
+        for (auto& worker : workers)
+            worker.join();
+        for (auto& error : errors)
+            if (error)
+                std::rethrow_exception(error);
+    }
+}
+
+class CapitalsTable
+{
+public:
+    CapitalsTable() = default;
+
+    static CapitalsTable load(const std::string& path, unsigned threads = std::thread::hardware_concurrency())
+    {
+        detail::MappedText file{path};
+        return parse(file.view(), threads);
+    }
+
+    static CapitalsTable parse(std::string_view text, unsigned threads = std::thread::hardware_concurrency())
+    {
+        if (threads == 0)
+            threads = 1;
+
+        std::vector<size_t> bounds{0};
+        for (unsigned i = 1; i < threads; ++i)
+        {
+            size_t start = detail::record_start(text, text.size() * i / threads);
+            if (start > bounds.back())
+                bounds.push_back(start);
+        }
+        if (text.size() > bounds.back())
+            bounds.push_back(text.size());
+        size_t chunk_count = bounds.size() - 1;
+
+        std::vector<Chunk> chunks(chunk_count);
+        detail::in_parallel(chunk_count, [&](size_t i)
+        {
+            chunks[i].parse(text.substr(bounds[i], bounds[i + 1] - bounds[i]));
+        });
+
+        CapitalsTable table;
+        size_t total_entries = 0, total_bytes = 0;
+        for (auto& chunk : chunks)
+        {
+            total_entries += chunk.entries.size();
+            total_bytes += chunk.blob.size();
+        }
+        table.blob.reserve(total_bytes);
+        table.entries.reserve(total_entries);
+        std::vector<uint64_t> hashes;
+        hashes.reserve(total_entries);
+        for (auto& chunk : chunks)
+        {
+            uint64_t base = table.blob.size();
+            table.blob += chunk.blob;
+            for (Entry entry : chunk.entries)
+            {
+                entry.offset += base;
+                table.entries.push_back(entry);
+            }
+            hashes.insert(hashes.end(), chunk.hashes.begin(), chunk.hashes.end());
+            chunk = Chunk{};
+        }
+        table.build_index(hashes, threads);
+        return table;
+    }
+
+    std::optional<int> find(std::string_view name) const
+    {
+        if (entries.empty())
+            return std::nullopt;
+        return find(name, hash_capital(name));
+    }
+
+    // Sums the populations of names, unknown names counting as 0.
+    // The names are handled in groups: all the hashes of a group are computed and their
+    // slots prefetched first, then the entries those slots point to are prefetched,
+    // and only then are the names compared, so the cache misses of a group overlap
+    // instead of being paid one after the other.
+    long long total_population(std::span<const std::string_view> names) const
+    {
+        if (entries.empty())
+            return 0;
+        constexpr size_t group = 16;
+        uint64_t hashes[group];
+        long long total = 0;
+        for (size_t start = 0; start < names.size(); start += group)
+        {
+            size_t count = std::min(group, names.size() - start);
+            for (size_t i = 0; i < count; ++i)
+            {
+                hashes[i] = hash_capital(names[start + i]);
+                __builtin_prefetch(&slots[home_slot(hashes[i])]);
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                uint64_t slot = slots[home_slot(hashes[i])];
+                if (slot != 0)
+                    __builtin_prefetch(&entries[static_cast<uint32_t>(slot) - 1]);
+            }
+            for (size_t i = 0; i < count; ++i)
+                if (auto population = find(names[start + i], hashes[i]))
+                    total += *population;
+        }
+        return total;
+    }
+
+    // number of distinct names
+    size_t size() const { return distinct; }
+
+    // Calls f(name, population) for every distinct name, in no particular order.
+    template <typename F>
+    void for_each(F&& f) const
+    {
+        for (uint64_t slot : slots)
+            if (slot != 0)
+            {
+                const Entry& entry = entries[static_cast<uint32_t>(slot) - 1];
+                f(name_of(entry), entry.population);
+            }
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t offset;
+        uint32_t length;
+        int population;
+    };
+
+    // The records of one chunk, with offsets into the chunk's own blob.
+    struct Chunk
+    {
+        std::string blob;
+        std::vector<Entry> entries;
+        std::vector<uint64_t> hashes;
+
+        void parse(std::string_view text)
+        {
+            while (!text.empty())
+            {
+                std::string_view name = detail::next_line(text);
+                if (name.empty())
+                    continue;
+                if (text.empty())
+                    throw std::runtime_error("missing population for " + std::string{name});
+                int population = detail::parse_population(detail::next_line(text), name);
+                entries.push_back({blob.size(), static_cast<uint32_t>(name.size()), population});
+                hashes.push_back(hash_capital(name));
+                blob.append(name);
+            }
+        }
+    };
+
+    std::string_view name_of(const Entry& entry) const
+    {
+        return {blob.data() + entry.offset, entry.length};
+    }
+
+    size_t region_of(uint64_t hash) const
+    {
+        return region_bits ? static_cast<size_t>(hash >> (64 - region_bits)) : 0;
+    }
+
+    // index in slots where the probe for hash starts
+    size_t home_slot(uint64_t hash) const
+    {
+        return (region_of(hash) << region_slot_bits) | (hash & ((size_t{1} << region_slot_bits) - 1));
+    }
+
+    std::optional<int> find(std::string_view name, uint64_t hash) const
+    {
+        size_t base = region_of(hash) << region_slot_bits;
+        size_t mask = (size_t{1} << region_slot_bits) - 1;
+        uint32_t tag = static_cast<uint32_t>(hash >> 32);
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            uint64_t slot = slots[base + i];
+            if (slot == 0)
+                return std::nullopt;
+            if (static_cast<uint32_t>(slot >> 32) == tag)
+            {
+                const Entry& entry = entries[static_cast<uint32_t>(slot) - 1];
+                if (name_of(entry) == name)
+                    return entry.population;
+            }
+        }
+    }
+
+    void build_index(const std::vector<uint64_t>& hashes, unsigned threads)
+    {
+        if (entries.size() >= UINT32_MAX)
+            throw std::length_error("too many capitals");
+
+        // one region per thread; each region is kept at most half full on average,
+        // and is rebuilt twice as big if the hashes happen to crowd one of them
+        region_bits = 0;
+        while ((1u << region_bits) < threads && region_bits < 8)
+            ++region_bits;
+        size_t regions = size_t{1} << region_bits;
+        region_slot_bits = 4;
+        while ((size_t{1} << region_slot_bits) * regions < entries.size() * 2)
+            ++region_slot_bits;
+
+        // the entries grouped by region with a counting sort, keeping their order within
+        // a region so that later records still win, so each thread only reads its own
+        std::vector<size_t> starts(regions + 1, 0);
+        for (uint64_t hash : hashes)
+            ++starts[region_of(hash) + 1];
+        for (size_t region = 0; region < regions; ++region)
+            starts[region + 1] += starts[region];
+        std::vector<uint32_t> order(entries.size());
+        {
+            std::vector<size_t> next(starts.begin(), starts.end() - 1);
+            for (size_t index = 0; index < entries.size(); ++index)
+                order[next[region_of(hashes[index])]++] = static_cast<uint32_t>(index);
+        }
+
+        for (;;)
+        {
+            size_t region_size = size_t{1} << region_slot_bits;
+            slots.assign(regions * region_size, 0);
+            std::vector<size_t> counts(regions, 0);
+            std::vector<char> full(regions, 0);
+            detail::in_parallel(regions, [&](size_t region)
+            {
+                uint64_t* region_slots = slots.data() + region * region_size;
+                size_t mask = region_size - 1;
+                for (size_t at = starts[region]; at < starts[region + 1]; ++at)
+                {
+                    uint32_t index = order[at];
+                    if (!insert(region_slots, mask, hashes[index], index, counts[region]))
+                    {
+                        full[region] = 1;
+                        return;
+                    }
+                }
+            });
+            if (std::find(full.begin(), full.end(), 1) == full.end())
+            {
+                distinct = 0;
+                for (size_t count : counts)
+                    distinct += count;
+                return;
+            }
+            ++region_slot_bits;
+        }
+    }
+
+    // Adds entry index to a region, or updates the population if the name is already there.
+    // Returns false if the region is more than 7/8 full.
+    bool insert(uint64_t* region_slots, size_t mask, uint64_t hash, size_t index, size_t& count)
+    {
+        uint32_t tag = static_cast<uint32_t>(hash >> 32);
+        std::string_view name = name_of(entries[index]);
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            uint64_t slot = region_slots[i];
+            if (slot == 0)
+            {
+                if ((count + 1) * 8 > (mask + 1) * 7)
+                    return false;
+                region_slots[i] = (uint64_t{tag} << 32) | (index + 1);
+                ++count;
+                return true;
+            }
+            if (static_cast<uint32_t>(slot >> 32) == tag)
+            {
+                Entry& existing = entries[static_cast<uint32_t>(slot) - 1];
+                if (name_of(existing) == name)
+                {
+                    // a later record of the same name wins
+                    existing.population = entries[index].population;
+                    return true;
+                }
+            }
+        }
+    }
+
+    std::string blob;
+    std::vector<Entry> entries;
+    // per slot: upper 32 bits of the hash, then entry index + 1; 0 when empty
+    std::vector<uint64_t> slots;
+    unsigned region_bits = 0;
+    unsigned region_slot_bits = 0;
+    size_t distinct = 0;
+};
@@ -0,0 +1,191 @@
+/**
+ * Offline compiler for the capitals database
+ *
+ * Reads capitals.txt (name line, population line, ...) and writes the binary image
+ * described in capitals-image.hpp, with a minimal perfect hash over the names.
+ * Usage: compile-capitals [capitals.txt] [capitals.bin]
+ *
+ * The displacements are searched bucket by bucket, biggest buckets first, while the
+ * table is still mostly empty. For each bucket d0 = 0, 1, ... is tried, and for each
+ * d0 the values of d1 that move the bucket's first name to a free slot: d1 shifts the
+ * whole bucket, so a bucket finds room in the end, even when only a few slots are left,
+ * unless two of its names hash alike; the search then starts over with another seed.
+ * Keeping a list of the free slots makes placing the last, single-name buckets O(1).
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "capitals-image.hpp"
+
+// d0 values tried per bucket before giving up on a seed
+constexpr uint32_t max_d0 = 64;
+
+struct Capital
+{
+    std::string_view name;
+    int population;
+    uint64_t hash;
+};
+
+// Finds a displacement pair for every bucket, filling owner (slot -> capital).
+// Returns false if some bucket cannot be placed with this seed.
+bool place_buckets(const std::vector<Capital>& capitals, uint64_t seed, uint64_t bucket_count,
+                   std::vector<uint32_t>& displacements, std::vector<uint32_t>& owner)
+{
+    uint64_t count = capitals.size();
+    std::vector<uint64_t> hashes(count);
+    std::vector<std::vector<uint32_t>> buckets(bucket_count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        hashes[i] = chd::seeded(capitals[i].hash, seed);
+        buckets[chd::bucket(hashes[i], bucket_count)].push_back(i);
+    }
+    std::vector<uint32_t> order(bucket_count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+    {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    displacements.assign(2 * bucket_count, 0);
+    owner.assign(count, UINT32_MAX);
+    // the free slots, and where each slot is in that list
+    std::vector<uint64_t> free_slots(count), position(count);
+    std::iota(free_slots.begin(), free_slots.end(), 0);
+    std::iota(position.begin(), position.end(), 0);
+
+    std::vector<uint64_t> slots;
+    for (uint32_t b : order)
+    {
+        const auto& members = buckets[b];
+        if (members.empty())
+            break;
+        bool placed = false;
+        for (uint32_t d0 = 0; d0 < max_d0 && !placed; ++d0)
+        {
+            // only the d1 values that send the first name to a free slot are worth trying
+            uint64_t first = (chd::h1(hashes[members[0]], count) + uint64_t{d0} * chd::h2(hashes[members[0]], count)) % count;
+            for (size_t f = 0; f < free_slots.size() && !placed; ++f)
+            {
+                uint32_t d1 = static_cast<uint32_t>((free_slots[f] + count - first) % count);
+                slots.clear();
+                for (uint32_t i : members)
+                {
+                    uint64_t s = chd::slot(hashes[i], count, d0, d1);
+                    if (owner[s] != UINT32_MAX || std::find(slots.begin(), slots.end(), s) != slots.end())
+                        break;
+                    slots.push_back(s);
+                }
+                if (slots.size() != members.size())
+                    continue;
+                for (size_t k = 0; k < members.size(); ++k)
+                {
+                    owner[slots[k]] = members[k];
+                    uint64_t last = free_slots.back();
+                    free_slots[position[slots[k]]] = last;
+                    position[last] = position[slots[k]];
+                    free_slots.pop_back();
+                }
+                displacements[2 * b] = d0;
+                displacements[2 * b + 1] = d1;
+                placed = true;
+            }
+        }
+        if (!placed)
+            return false;
+    }
+    return true;
+}
+
+void write_image(const std::string& path, const std::vector<Capital>& capitals)
+{
+    uint64_t count = capitals.size();
+    uint64_t bucket_count = std::max<uint64_t>(1, (count + chd::bucket_size - 1) / chd::bucket_size);
+
+    std::vector<uint32_t> displacements, owner;
+    uint64_t seed = 0;
+    while (!place_buckets(capitals, seed, bucket_count, displacements, owner))
+        ++seed;
+
+    std::vector<uint64_t> keys(count);
+    std::vector<int32_t> values(count);
+    std::string blob;
+    for (uint64_t s = 0; s < count; ++s)
+    {
+        const Capital& capital = owner[s] == UINT32_MAX ? Capital{} : capitals[owner[s]];
+        keys[s] = (uint64_t{capital.name.size()} << 40) | blob.size();
+        values[s] = capital.population;
+        blob.append(capital.name);
+    }
+
+    // the slots in name order, for the prefix index
+    std::vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    auto name_of = [&](uint32_t s) { return owner[s] == UINT32_MAX ? std::string_view{} : capitals[owner[s]].name; };
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return name_of(a) < name_of(b); });
+
+    CapitalsImageHeader header{};
+    std::memcpy(header.magic, capitals_magic, sizeof header.magic);
+    header.version = capitals_version;
+    header.byte_order = capitals_byte_order;
+    header.count = count;
+    header.bucket_count = bucket_count;
+    header.blob_size = blob.size();
+    header.seed = seed;
+
+    // write to a temporary file and rename it, so readers never map a half-written image
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof header);
+        out.write(reinterpret_cast<const char*>(displacements.data()), static_cast<std::streamsize>(displacements.size() * sizeof(uint32_t)));
+        out.write(reinterpret_cast<const char*>(keys.data()), static_cast<std::streamsize>(keys.size() * sizeof(uint64_t)));
+        out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(int32_t)));
+        out.write(reinterpret_cast<const char*>(order.data()), static_cast<std::streamsize>(order.size() * sizeof(uint32_t)));
+        out.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+        if (!out)
+            throw std::runtime_error("cannot write " + temporary);
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("cannot replace " + path);
+}
+
+int main(int argc, char* argv[])
+{
+    std::string input = argc > 1 ? argv[1] : "capitals.txt";
+    std::string output = argc > 2 ? argv[2] : "capitals.bin";
+
+    try
+    {
+        auto start = std::chrono::steady_clock::now();
+        CapitalsTable table = CapitalsTable::load(input);
+        std::vector<Capital> capitals;
+        capitals.reserve(table.size());
+        table.for_each([&](std::string_view name, int population)
+        {
+            capitals.push_back({name, population, hash_capital(name)});
+        });
+        write_image(output, capitals);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        CapitalsImage image{output};
+        for (auto& capital : capitals)
+            if (image.find(capital.name) != capital.population)
+                throw std::runtime_error("image check failed for " + std::string{capital.name});
+        std::cout << "compiled " << capitals.size() << " capitals into " << output << " ("
+                  << image.mapped_bytes() << " bytes) in " << elapsed.count() << " s" << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "compile-capitals: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
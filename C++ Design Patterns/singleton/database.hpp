@@ -0,0 +1,71 @@
+/**
+ * Database interface
+ *
+ * The common interface of the population databases, so that code such as
+ * ConfigurableRecordFinder can be given the singleton, a test double, or a decorator
+ * around another database.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "worker-pool.hpp"
+
+class Database {
+public:
+    virtual ~Database() = default;
+
+    // Returns the population of name, or nothing for an unknown city. Lookups never
+    // modify the database, so many threads can query it at once without locking.
+    virtual std::optional<int> find(std::string_view name) const = 0;
+
+    int get_population(std::string_view name) const
+    {
+        return find(name).value_or(0);
+    }
+
+    // Sums the populations of names, unknown cities counting as 0.
+    // Batches of more than parallel_batch names are split over the shared worker pool.
+    virtual long long total_population(std::span<const std::string_view> names) const
+    {
+        return split_batch(names, [this](std::span<const std::string_view> part) { return sum_populations(part); });
+    }
+
+    static constexpr size_t parallel_batch = 1 << 16;
+
+protected:
+    // Sums sum(part) over the parts of names: one part per pool thread, each at least
+    // parallel_batch names long, or names as a whole if it is shorter than two of them.
+    template <typename Sum>
+    static long long split_batch(std::span<const std::string_view> names, Sum&& sum)
+    {
+        WorkerPool& pool = WorkerPool::shared();
+        size_t parts = std::min(pool.size(), names.size() / parallel_batch);
+        if (parts <= 1)
+            return sum(names);
+
+        std::vector<long long> totals(parts);
+        pool.run(parts, [&](size_t i)
+        {
+            size_t begin = names.size() * i / parts, end = names.size() * (i + 1) / parts;
+            totals[i] = sum(names.subspan(begin, end - begin));
+        });
+        return std::accumulate(totals.begin(), totals.end(), 0LL);
+    }
+
+    // Sums one part of a batch; the default looks the names up one at a time.
+    virtual long long sum_populations(std::span<const std::string_view> names) const
+    {
+        long long total = 0;
+        for (auto name : names)
+            total += get_population(name);
+        return total;
+    }
+};
@@ -0,0 +1,146 @@
+/**
+ * Background watcher for data files
+ *
+ * FileWatcher calls a function on its own thread whenever one of the watched files
+ * is written or replaced. On Linux it uses inotify on the directories of the files,
+ * so that both writing a file in place and renaming a new file over it are seen.
+ * Where inotify is not available it falls back to comparing the files' modification
+ * time, size and inode every poll interval.
+ * Changes that arrive in quick succession are reported once, after the files have
+ * been quiet for a short while, so a reload does not start on a half-written file.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class FileWatcher
+{
+public:
+    FileWatcher(std::vector<std::string> paths, std::function<void()> on_change,
+                std::chrono::milliseconds interval = std::chrono::milliseconds{500})
+        : paths{std::move(paths)}, on_change{std::move(on_change)}, interval{interval}
+    {
+        fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd >= 0)
+        {
+            for (auto& path : this->paths)
+            {
+                size_t slash = path.rfind('/');
+                std::string directory = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+                if (::inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+                {
+                    ::close(fd);
+                    fd = -1;
+                    break;
+                }
+            }
+        }
+        thread = std::thread{[this] { fd >= 0 ? watch() : poll_files(); }};
+    }
+
+    ~FileWatcher()
+    {
+        stopping = true;
+        thread.join();
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    FileWatcher(FileWatcher const&) = delete;
+    void operator=(FileWatcher const&) = delete;
+
+    // true if the watcher had to fall back to polling
+    bool polling() const { return fd < 0; }
+
+private:
+    // how long the files must be quiet before on_change is called
+    static constexpr std::chrono::milliseconds settle{100};
+
+    void watch()
+    {
+        bool pending = false;
+        alignas(inotify_event) char buffer[4096];
+        while (!stopping)
+        {
+            pollfd request{fd, POLLIN, 0};
+            int timeout = static_cast<int>(pending ? settle.count() : interval.count());
+            if (::poll(&request, 1, timeout) > 0)
+            {
+                ssize_t length;
+                while ((length = ::read(fd, buffer, sizeof buffer)) > 0)
+                {
+                    for (char* p = buffer; p < buffer + length;)
+                    {
+                        auto event = reinterpret_cast<inotify_event*>(p);
+                        if (event->len && watched(event->name))
+                            pending = true;
+                        p += sizeof(inotify_event) + event->len;
+                    }
+                }
+            }
+            else if (pending)
+            {
+                pending = false;
+                on_change();
+            }
+        }
+    }
+
+    void poll_files()
+    {
+        std::vector<struct stat> last(paths.size());
+        for (size_t i = 0; i < paths.size(); ++i)
+            read_status(i, last[i]);
+        while (!stopping)
+        {
+            std::this_thread::sleep_for(interval);
+            bool changed = false;
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                struct stat now;
+                read_status(i, now);
+                if (now.st_mtim.tv_sec != last[i].st_mtim.tv_sec || now.st_mtim.tv_nsec != last[i].st_mtim.tv_nsec
+                    || now.st_size != last[i].st_size || now.st_ino != last[i].st_ino)
+                    changed = true;
+                last[i] = now;
+            }
+            if (changed && !stopping)
+                on_change();
+        }
+    }
+
+    void read_status(size_t i, struct stat& status) const
+    {
+        if (::stat(paths[i].c_str(), &status) != 0)
+            status = {};
+    }
+
+    bool watched(const char* name) const
+    {
+        for (auto& path : paths)
+        {
+            size_t slash = path.rfind('/');
+            if (path.compare(slash == std::string::npos ? 0 : slash + 1, std::string::npos, name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    std::vector<std::string> paths;
+    std::function<void()> on_change;
+    std::chrono::milliseconds interval;
+    int fd = -1;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+};
@@ -13,31 +13,125 @@
  */
 
 #include <map>
+#include <memory>
 #include <iostream>
-#include <fstream>
-#include <boost/lexical_cast.hpp>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bill-pugh-singleton.hpp"
+#include "caching-database.hpp"
+#include "capitals-image.hpp"
+#include "capitals-loader.hpp"
+#include "database.hpp"
+#include "file-watcher.hpp"
+#include "prefix-index.hpp"
+#include "snapshot-holder.hpp"
+
+// The capitals currently served: a compiled image if one is up to date, the parsed text otherwise,
+// and the prefix index over them. load() builds the index before the capitals are published,
+// so no query waits for it; from an image it reads the stored name order instead of sorting.
+struct Capitals
+{
+    std::optional<CapitalsImage> image;
+    CapitalsTable table;
+    // views into image or table
+    PrefixIndex prefixes;
 
-class Database {
-public:
-    virtual int get_population(const std::string& name) = 0;
+    std::optional<int> find(std::string_view name) const
+    {
+        return image ? image->find(name) : table.find(name);
+    }
+
+    long long total_population(std::span<const std::string_view> names) const
+    {
+        return image ? image->total_population(names) : table.total_population(names);
+    }
 };
 
 class SingletonDatabase: public Database
 {
     SingletonDatabase()
+        : capitals{load()}, watcher{{text_path, image_path}, [this] { reload(); }}
     {
         std::cout << "Initializing database\n" << std::endl;
-        std::ifstream ifs("capitals.txt");
+    }
+
+    static std::unique_ptr<const Capitals> load()
+    {
+        auto capitals = std::make_unique<Capitals>();
+        const char* path = source();
+        // the image written by compile-capitals is mapped as it is, without parsing
+        if (path == image_path)
+        {
+            try
+            {
+                capitals->image.emplace(image_path);
+            }
+            catch (const std::runtime_error& e)
+            {
+                // a corrupt image falls back to the text it was compiled from, if there is one
+                if (::access(text_path, R_OK) != 0)
+                    throw;
+                std::cerr << "ignoring " << image_path << ": " << e.what() << std::endl;
+                path = text_path;
+            }
+        }
+        // like the old std::ifstream reader, a missing file gives an empty database
+        if (path == text_path)
+            capitals->table = CapitalsTable::load(text_path);
+        capitals->prefixes = capitals->image ? PrefixIndex{*capitals->image} : PrefixIndex{capitals->table};
+        return capitals;
+    }
+
+    // The file to load, or nullptr if neither can be read. The image is preferred unless
+    // capitals.txt was modified after it, so that edits to the text are not hidden by an
+    // image compiled from an older version until compile-capitals is run again.
+    static const char* source()
+    {
+        struct stat text{}, image{};
+        bool has_text = ::access(text_path, R_OK) == 0 && ::stat(text_path, &text) == 0;
+        bool has_image = ::access(image_path, R_OK) == 0 && ::stat(image_path, &image) == 0;
+        if (has_image && !(has_text && newer(text.st_mtim, image.st_mtim)))
+            return image_path;
+        return has_text ? text_path : nullptr;
+    }
+
+    static bool newer(const timespec& a, const timespec& b)
+    {
+        return a.tv_sec != b.tv_sec ? a.tv_sec > b.tv_sec : a.tv_nsec > b.tv_nsec;
+    }
 
-        std::string s, s2;
-        while (std::getline(ifs, s))
+    // Called on the watcher's thread; queries keep using the previous capitals until
+    // the new ones are published, and a file that fails to load leaves them in place.
+    void reload()
+    {
+        try
+        {
+            capitals.publish(load());
+        }
+        catch (const std::exception& e)
         {
-            std::getline(ifs, s2);
-            int population = boost::lexical_cast<int>(s2);
-            capitals[s] = population;
+            std::cerr << "keeping the current capitals: " << e.what() << std::endl;
         }
     }
-    std::map<std::string, int> capitals;
+
+    // the names are copied because a reload may free the capitals they point into
+    static std::vector<std::pair<std::string, int>> copy(const std::vector<PrefixIndex::City>& cities)
+    {
+        return {cities.begin(), cities.end()};
+    }
+
+    static constexpr const char* text_path = "capitals.txt";
+    static constexpr const char* image_path = "capitals.bin";
+
+    // each version is frozen once loaded and replaced as a whole
+    SnapshotHolder<Capitals> capitals;
+    // declared last so that it stops before the capitals go away
+    FileWatcher watcher;
 
 public:
     // ensuring that is not possible to create a new instance of SingletonDatabase
@@ -51,84 +145,90 @@ public:
         return db;
     }
 
-    int get_population(const std::string& name)
+    std::optional<int> find(std::string_view name) const override
+    {
+        return capitals.read()->find(name);
+    }
+
+    // Every city whose name starts with prefix, in name order.
+    std::vector<std::pair<std::string, int>> cities_with_prefix(std::string_view prefix) const
     {
-        return capitals[name];
+        return copy(capitals.read()->prefixes.with_prefix(prefix));
+    }
+
+    // The k most populated cities whose name starts with prefix, most populated first.
+    std::vector<std::pair<std::string, int>> top_by_population(std::string_view prefix, size_t k) const
+    {
+        return copy(capitals.read()->prefixes.top(prefix, k));
+    }
+
+    // number of times the capitals have been reloaded
+    uint64_t reloads() const { return capitals.version(); }
+
+    // The whole batch is summed over one snapshot, even when its parts run on other
+    // threads, so that a reload in the middle cannot mix two versions of the capitals.
+    long long total_population(std::span<const std::string_view> names) const override
+    {
+        auto snapshot = capitals.read();
+        return split_batch(names, [&](std::span<const std::string_view> part)
+        {
+            return snapshot->total_population(part);
+        });
     }
 };
 
 class DummyDatabase: public Database
 {
-    std::map<std::string, int> capitals;
+    // std::less<> lets find() take a string_view without building a std::string
+    const std::map<std::string, int, std::less<>> capitals{
+        {"alpha", 1},
+        {"beta", 2},
+        {"gamma", 3}
+    };
 public:
-    DummyDatabase()
-    {
-        capitals["alpha"] = 1;
-        capitals["beta"] = 2;
-        capitals["gamma"] = 3;
-    }
-
-    int get_population(const std::string& name) override
+    std::optional<int> find(std::string_view name) const override
     {
-        return capitals[name];
+        auto it = capitals.find(name);
+        if (it == capitals.end())
+            return std::nullopt;
+        return it->second;
     }
 };
 
 struct SingletonRecordFinder
 {
-    int total_population(std::vector<std::string> names)
+    int total_population(const std::vector<std::string>& names) const
     {
         int result = 0;
         for (auto& name: names)
             result += SingletonDatabase::get().get_population(name);
         return result;
     }
+
+    long long total_population(std::span<const std::string_view> names) const
+    {
+        return SingletonDatabase::get().total_population(names);
+    }
 };
 
 struct ConfigurableRecordFinder
 {
-    Database& db;
+    const Database& db;
 
-    ConfigurableRecordFinder(Database& db): db(db) {}
+    ConfigurableRecordFinder(const Database& db): db(db) {}
 
-    int total_population(std::vector<std::string> names)
+    int total_population(const std::vector<std::string>& names) const
     {
         int result = 0;
         for (auto& name: names)
             result += db.get_population(name);
         return result;
     }
-};
-
-/**
- * Example of the Bill Pugh singleton implementation
- * Here, an inner class is used to create the singleton instance using a static method
- * and is one of the most widely used variants for implementing the singleton pattern
- */
-struct BillPughSingleton
-{
-    static BillPughSingleton instance()
-    {
-        return InnerBillPughSingleton::unique_instance;
-    }
 
-    std::string get_value(std::string key)
+    long long total_population(std::span<const std::string_view> names) const
     {
-        return database[key];
+        return db.total_population(names);
     }
-
-    void operator=(BillPughSingleton const&) = delete;
-
-private:
-
-    std::map<std::string, std::string> database;
-
-    BillPughSingleton() {}
-
-    struct InnerBillPughSingleton
-    {
-        static BillPughSingleton unique_instance; 
-    };
 };
 
 int main()
@@ -137,7 +237,16 @@ int main()
     std::cout << city << " has population " <<
     SingletonDatabase::get().get_population(city) << std::endl;
 
-    BillPughSingleton instance = BillPughSingleton::instance();
+    // a slow backend behind a cache: the second lookup of each city is served from memory
+    SlowDatabase slow{{{"alpha", 1}, {"beta", 2}}, std::chrono::milliseconds{10}};
+    CachingDatabase cached{slow, 1024};
+    ConfigurableRecordFinder finder{cached};
+    std::cout << "total " << finder.total_population({"alpha", "beta", "alpha", "omega", "omega"})
+              << ", backend queries " << slow.query_count()
+              << ", cache hit rate " << cached.stats().hit_rate() << std::endl;
+
+    BillPughSingleton& instance = BillPughSingleton::instance();
+    instance.put("some_key", "some_value");
     std::cout << "Value: " << instance.get_value("some_key") << std::endl;
 
     return 0;
@@ -0,0 +1,212 @@
+/**
+ * Prefix and top-K index over the capitals
+ *
+ * The names are kept sorted, so the cities starting with a prefix are one contiguous
+ * range, found by binary search. To answer "the K most populated cities in that range"
+ * without scanning it, the index can find the position of the largest population in any
+ * range quickly:
+ *  - the populations are split into blocks of 32, and a sparse table holds, for every
+ *    run of 2^j consecutive blocks, where its maximum is. That costs one uint32 per
+ *    block and level, about n / 32 * log2(n / 32) entries, instead of n log n;
+ *  - the maximum of a range is the better of the sparse-table answer for the whole
+ *    blocks it covers and a scan of the at most 62 populations at its two ends.
+ * top() then keeps a heap of ranges ordered by their maximum: it pops the best range,
+ * reports its maximum and pushes the two ranges on either side of it. K results cost
+ * K pops and 2K range-maximum queries, O(K log K) after the O(|prefix| log n) search.
+ *
+ * The index keeps views of the names it was built from rather than copies, so its source
+ * must outlive it. A source that can already list its names in order (the compiled image
+ * stores that order) is not sorted again, so building the index costs one pass over the
+ * names and the sparse table.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <queue>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class PrefixIndex
+{
+public:
+    typedef std::pair<std::string_view, int> City;
+
+    PrefixIndex() = default;
+
+    // source.for_each(f) must call f(name, population) once per city; if source also has
+    // for_each_by_name(f), that is used instead and must call f in name order.
+    template <typename Source>
+    explicit PrefixIndex(const Source& source)
+    {
+        auto add = [this](std::string_view name, int population)
+        {
+            names.push_back(name);
+            populations.push_back(population);
+        };
+        if constexpr (requires { source.for_each_by_name(add); })
+            source.for_each_by_name(add);
+        else
+        {
+            std::vector<City> cities;
+            source.for_each([&](std::string_view name, int population) { cities.emplace_back(name, population); });
+            std::sort(cities.begin(), cities.end());
+            names.reserve(cities.size());
+            populations.reserve(cities.size());
+            for (auto& [name, population] : cities)
+                add(name, population);
+        }
+        build_sparse_table();
+    }
+
+    size_t size() const { return populations.size(); }
+
+    // Every city whose name starts with prefix, in name order.
+    std::vector<City> with_prefix(std::string_view prefix) const
+    {
+        auto [begin, end] = range(prefix);
+        std::vector<City> result;
+        result.reserve(end - begin);
+        for (size_t i = begin; i < end; ++i)
+            result.emplace_back(name(i), populations[i]);
+        return result;
+    }
+
+    size_t count(std::string_view prefix) const
+    {
+        auto [begin, end] = range(prefix);
+        return end - begin;
+    }
+
+    // The (at most) k most populated cities whose name starts with prefix, most populated first.
+    std::vector<City> top(std::string_view prefix, size_t k) const
+    {
+        auto [begin, end] = range(prefix);
+        std::vector<City> result;
+        if (begin == end || k == 0)
+            return result;
+        result.reserve(std::min(k, end - begin));
+
+        // (population of the range's maximum, its position, the range)
+        struct Candidate
+        {
+            int population;
+            size_t position, begin, end;
+            bool operator<(const Candidate& other) const { return population < other.population; }
+        };
+        std::priority_queue<Candidate> heap;
+        auto push = [&](size_t b, size_t e)
+        {
+            if (b < e)
+            {
+                size_t position = max_position(b, e);
+                heap.push({populations[position], position, b, e});
+            }
+        };
+
+        push(begin, end);
+        while (result.size() < k && !heap.empty())
+        {
+            Candidate best = heap.top();
+            heap.pop();
+            result.emplace_back(name(best.position), best.population);
+            push(best.begin, best.position);
+            push(best.position + 1, best.end);
+        }
+        return result;
+    }
+
+private:
+    static constexpr size_t block_bits = 5;
+    static constexpr size_t block_size = size_t{1} << block_bits;
+
+    std::string_view name(size_t i) const { return names[i]; }
+
+    // [begin, end) of the names starting with prefix
+    std::pair<size_t, size_t> range(std::string_view prefix) const
+    {
+        size_t low = 0, high = populations.size();
+        // first name not less than prefix
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+            if (name(middle) < prefix)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        size_t begin = low;
+        high = populations.size();
+        // first name, from there, that does not start with prefix
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+            if (name(middle).substr(0, prefix.size()) == prefix)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return {begin, low};
+    }
+
+    size_t better(size_t a, size_t b) const
+    {
+        return populations[b] > populations[a] ? b : a;
+    }
+
+    size_t scan(size_t begin, size_t end) const
+    {
+        size_t best = begin;
+        for (size_t i = begin + 1; i < end; ++i)
+            best = better(best, i);
+        return best;
+    }
+
+    void build_sparse_table()
+    {
+        size_t blocks = (populations.size() + block_size - 1) / block_size;
+        levels.clear();
+        if (blocks == 0)
+            return;
+        std::vector<uint32_t> level(blocks);
+        for (size_t b = 0; b < blocks; ++b)
+            level[b] = static_cast<uint32_t>(scan(b * block_size, std::min(populations.size(), (b + 1) * block_size)));
+        levels.push_back(std::move(level));
+        for (size_t width = 1; width * 2 <= blocks; width *= 2)
+        {
+            const auto& previous = levels.back();
+            std::vector<uint32_t> next(blocks - width * 2 + 1);
+            for (size_t b = 0; b < next.size(); ++b)
+                next[b] = static_cast<uint32_t>(better(previous[b], previous[b + width]));
+            levels.push_back(std::move(next));
+        }
+    }
+
+    // position of the largest population in [begin, end), which must not be empty
+    size_t max_position(size_t begin, size_t end) const
+    {
+        size_t first_block = (begin + block_size - 1) >> block_bits;
+        size_t last_block = end >> block_bits;
+        if (first_block >= last_block)
+            return scan(begin, end);
+
+        size_t count = last_block - first_block;
+        size_t level = 63 - static_cast<size_t>(__builtin_clzll(count));
+        size_t best = better(levels[level][first_block], levels[level][last_block - (size_t{1} << level)]);
+        if (begin < first_block * block_size)
+            best = better(scan(begin, first_block * block_size), best);
+        if (last_block * block_size < end)
+            best = better(best, scan(last_block * block_size, end));
+        return best;
+    }
+
+    // views into the source, sorted
+    std::vector<std::string_view> names;
+    std::vector<int> populations;
+    // levels[j][b]: position of the largest population in blocks [b, b + 2^j)
+    std::vector<std::vector<uint32_t>> levels;
+};
@@ -0,0 +1,129 @@
+/**
+ * Read-copy-update holder for an immutable snapshot
+ *
+ * SnapshotHolder<T> owns the current version of some read-only data and lets a writer
+ * replace it while readers keep using it:
+ *  - read() returns a guard through which the current snapshot can be used; a reader
+ *    never takes a lock and never waits, it only bumps a counter on entry and exit;
+ *  - publish() swaps in a new snapshot with one atomic store. Readers that started
+ *    before the swap finish on the old snapshot, which is deleted once they are done.
+ *
+ * Reclamation is epoch based. Readers register in the counter of the current epoch's
+ * parity; publish() flips the epoch after the swap and waits until no reader is left
+ * in the old parity, so nobody can still hold the old pointer. The counters are spread
+ * over cache-line sized stripes, picked per thread, so that readers on different cores
+ * do not all write to the same line. Only the writer ever waits.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+template <typename T>
+class SnapshotHolder
+{
+    struct alignas(64) Stripe
+    {
+        std::atomic<uint32_t> readers[2] = {};
+    };
+
+public:
+    class ReadGuard
+    {
+    public:
+        ReadGuard(ReadGuard&& other) noexcept
+            : stripe{other.stripe}, epoch{other.epoch}, snapshot{other.snapshot}
+        {
+            other.stripe = nullptr;
+        }
+
+        ReadGuard(ReadGuard const&) = delete;
+        void operator=(ReadGuard const&) = delete;
+
+        ~ReadGuard()
+        {
+            if (stripe)
+                stripe->readers[epoch].fetch_sub(1, std::memory_order_release);
+        }
+
+        const T& operator*() const { return *snapshot; }
+        const T* operator->() const { return snapshot; }
+
+    private:
+        friend class SnapshotHolder;
+
+        ReadGuard(Stripe* stripe, unsigned epoch, const T* snapshot)
+            : stripe{stripe}, epoch{epoch}, snapshot{snapshot} {}
+
+        Stripe* stripe;
+        unsigned epoch;
+        const T* snapshot;
+    };
+
+    explicit SnapshotHolder(std::unique_ptr<const T> initial)
+        : current{initial.release()} {}
+
+    ~SnapshotHolder()
+    {
+        delete current.load();
+    }
+
+    SnapshotHolder(SnapshotHolder const&) = delete;
+    void operator=(SnapshotHolder const&) = delete;
+
+    // The guard keeps the snapshot alive; keep it only for the duration of a query.
+    ReadGuard read() const
+    {
+        Stripe& stripe = stripes[stripe_index()];
+        for (;;)
+        {
+            unsigned e = epoch.load();
+            stripe.readers[e].fetch_add(1);
+            if (epoch.load() == e)
+                return ReadGuard{&stripe, e, current.load()};
+            // a publish flipped the epoch in between, register in the new one
+            stripe.readers[e].fetch_sub(1);
+        }
+    }
+
+    // Makes next the snapshot seen by new readers and deletes the previous one
+    // once the readers that may still use it are done. Waits for those readers.
+    void publish(std::unique_ptr<const T> next)
+    {
+        std::lock_guard<std::mutex> lock{writer};
+        const T* previous = current.exchange(next.release());
+        ++versions;
+
+        unsigned old_epoch = epoch.load();
+        epoch.store(old_epoch ^ 1);
+        for (auto& stripe : stripes)
+            while (stripe.readers[old_epoch].load() != 0)
+                std::this_thread::yield();
+
+        delete previous;
+    }
+
+    // number of snapshots published since construction
+    uint64_t version() const { return versions.load(); }
+
+private:
+    static constexpr size_t stripe_count = 16;
+
+    static size_t stripe_index()
+    {
+        thread_local size_t index = std::hash<std::thread::id>{}(std::this_thread::get_id()) % stripe_count;
+        return index;
+    }
+
+    std::atomic<const T*> current;
+    std::atomic<unsigned> epoch{0};
+    mutable Stripe stripes[stripe_count];
+    std::mutex writer;
+    std::atomic<uint64_t> versions{0};
+};
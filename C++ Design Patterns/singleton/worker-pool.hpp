@@ -0,0 +1,154 @@
+/**
+ * Persistent pool of worker threads
+ *
+ * WorkerPool::shared() starts one thread per core but one the first time it is used,
+ * and keeps them until the program exits, so splitting a query over the cores costs
+ * a queue push per part instead of creating and joining threads every time.
+ *
+ * run(parts, f) calls f(0), ..., f(parts - 1) and returns once all of them are done.
+ * The calling thread works too: it runs part 0, then takes queued parts (its own or
+ * those of other callers) until its own are finished. It only sleeps when the queue is
+ * empty, that is when every part it waits for is already running, so run() cannot
+ * deadlock even when all the workers are busy or when a part calls run() itself.
+ * If parts throw, run() rethrows the first exception once every part has finished.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkerPool
+{
+public:
+    explicit WorkerPool(unsigned threads)
+    {
+        for (unsigned t = 0; t < threads; ++t)
+            workers.emplace_back([this] { work(); });
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    WorkerPool(WorkerPool const&) = delete;
+    void operator=(WorkerPool const&) = delete;
+
+    static WorkerPool& shared()
+    {
+        static WorkerPool pool{std::max(1u, std::thread::hardware_concurrency()) - 1};
+        return pool;
+    }
+
+    // threads that run parts, counting the caller of run()
+    size_t size() const { return workers.size() + 1; }
+
+    template <typename F>
+    void run(size_t parts, F&& f)
+    {
+        if (parts == 0)
+            return;
+        Job job;
+        job.part = std::ref(f);
+        job.remaining = parts;
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            for (size_t i = 1; i < parts; ++i)
+                queue.push_back({&job, i});
+        }
+        if (parts > 2)
+            ready.notify_all();
+        else if (parts == 2)
+            ready.notify_one();
+
+        execute({&job, 0});
+        std::unique_lock<std::mutex> lock{mutex};
+        while (job.remaining != 0)
+        {
+            if (queue.empty())
+            {
+                job.done.wait(lock);
+                continue;
+            }
+            Task task = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            execute(task);
+            lock.lock();
+        }
+        if (job.error)
+            std::rethrow_exception(job.error);
+    }
+
+private:
+    // One call to run(); it lives on the caller's stack until all its parts are done.
+    struct Job
+    {
+        std::function<void(size_t)> part;
+        // parts not finished yet, guarded by the pool's mutex like error
+        size_t remaining = 0;
+        std::exception_ptr error;
+        std::condition_variable done;
+    };
+
+    struct Task
+    {
+        Job* job;
+        size_t index;
+    };
+
+    void execute(Task task)
+    {
+        std::exception_ptr error;
+        try
+        {
+            task.job->part(task.index);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock{mutex};
+        if (error && !task.job->error)
+            task.job->error = error;
+        // notified under the lock: the caller may destroy the job as soon as it sees 0
+        if (--task.job->remaining == 0)
+            task.job->done.notify_all();
+    }
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock{mutex};
+        for (;;)
+        {
+            ready.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+            Task task = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            execute(task);
+            lock.lock();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Task> queue;
+    bool stopping = false;
+};
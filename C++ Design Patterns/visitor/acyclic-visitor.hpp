@@ -9,7 +9,9 @@
  * The ExpressionPrinter class implements the Visitor interface to provide specific operations.
  */
 
-#include <sstream>
+#include <string>
+#include <string_view>
+#include "output-buffer.hpp"
 
 template <typename Visitable>
 struct Visitor
@@ -71,6 +73,17 @@ struct AdditionExpression : Expression
 
 struct ExpressionPrinter : VisitorBase, Visitor<DoubleExpression>, Visitor<AdditionExpression>
 {
+    std::string str() const { return oss.str(); }
+    std::string_view view() const { return oss.view(); }
+    void clear() { oss.clear(); }
+
+    void reserve_for(Expression& e)
+    {
+        oss.begin_measure();
+        e.accept(*this);
+        oss.end_measure();
+    }
+
     void visit(DoubleExpression& obj) override
     {
         oss << obj.value;
@@ -85,5 +98,5 @@ struct ExpressionPrinter : VisitorBase, Visitor<DoubleExpression>, Visitor<Addit
         oss << ")";
     }
 private:
-    std::ostringstream oss;
+    OutputBuffer oss;
 };
\ No newline at end of file
@@ -1,5 +1,12 @@
 #include "classic-visitor.hpp"
 
+void ExpressionPrinter::reserve_for(Expression* e)
+{
+    oss.begin_measure();
+    e->accept(this);
+    oss.end_measure();
+}
+
 void ExpressionPrinter::visit(DoubleExpression* de)
 {
     oss << de->value;
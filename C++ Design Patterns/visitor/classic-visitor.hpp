@@ -13,6 +13,7 @@
 
 #include <sstream>
 #include <iostream>
+#include "output-buffer.hpp"
 
 struct DoubleExpression;
 struct AdditionExpression;
@@ -28,10 +29,17 @@ struct ExpressionVisitor
 // Following the single responsabilitz principle
 // ExpressionPrinter only takes care of printing the expression
 // whereas ExpressionEvaluator takes care of evaluating the expression
+struct Expression;
+
 struct ExpressionPrinter: ExpressionVisitor
 {
-    std::ostringstream oss;
+    OutputBuffer oss;
     std::string str() const { return oss.str(); }
+    std::string_view view() const { return oss.view(); }
+    // reuse the buffer for the next expression without releasing its memory
+    void clear() { oss.clear(); }
+    // optional first pass that sizes the buffer for e before printing it
+    void reserve_for(Expression* e);
     void visit(DoubleExpression* de) override;
     void visit(AdditionExpression* ae) override;
     void visit(SubtractionExpression* se) override;
@@ -0,0 +1,174 @@
+/*
+ * Hash-Consed Expressions
+ *
+ * Hash-consing is a Flyweight applied to expression trees: structurally identical
+ * subexpressions are created only once and shared, which turns the tree into a DAG.
+ * The ExpressionFactory owns every node and looks up (kind, value, left, right)
+ * in a hash table before allocating, so two requests for "1+2" return the same node.
+ * Because children are already unique, comparing them by pointer is enough and the
+ * lookup is O(1) regardless of the size of the subtree.
+ * The MemoizingEvaluator visits each shared node once per evaluation pass and reuses
+ * the cached value everywhere else the node appears.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+struct SharedExpression
+{
+    enum Kind : std::uint8_t { constant, addition, subtraction } kind;
+    // dense, factory-local id used by evaluators to index their caches
+    std::uint32_t id;
+    double value;
+    const SharedExpression* left;
+    const SharedExpression* right;
+};
+
+class ExpressionFactory
+{
+public:
+    ExpressionFactory() = default;
+    ExpressionFactory(ExpressionFactory const&) = delete;
+    void operator=(ExpressionFactory const&) = delete;
+
+    const SharedExpression* constant(double value)
+    {
+        return make(SharedExpression::constant, value, nullptr, nullptr);
+    }
+
+    const SharedExpression* add(const SharedExpression* left, const SharedExpression* right)
+    {
+        return make(SharedExpression::addition, 0.0, left, right);
+    }
+
+    const SharedExpression* subtract(const SharedExpression* left, const SharedExpression* right)
+    {
+        return make(SharedExpression::subtraction, 0.0, left, right);
+    }
+
+    // number of distinct nodes, i.e. the number of allocations actually made
+    std::size_t size() const { return nodes.size(); }
+
+    // number of node requests, including the ones answered from the table
+    std::size_t requests() const { return requested; }
+
+private:
+    struct NodeHash
+    {
+        std::size_t operator()(const SharedExpression* e) const
+        {
+            std::uint64_t bits;
+            std::memcpy(&bits, &e->value, sizeof bits);
+            std::size_t seed = std::hash<std::uint64_t>{}(bits) ^ e->kind;
+            seed ^= std::hash<const void*>{}(e->left) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            seed ^= std::hash<const void*>{}(e->right) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            return seed;
+        }
+    };
+
+    struct NodeEqual
+    {
+        bool operator()(const SharedExpression* a, const SharedExpression* b) const
+        {
+            // children are unique already, so pointer equality is structural equality;
+            // values are compared bitwise so that 0.0 and -0.0 stay distinct
+            return a->kind == b->kind
+                && std::memcmp(&a->value, &b->value, sizeof a->value) == 0
+                && a->left == b->left
+                && a->right == b->right;
+        }
+    };
+
+    const SharedExpression* make(SharedExpression::Kind kind, double value,
+                                 const SharedExpression* left, const SharedExpression* right)
+    {
+        ++requested;
+        SharedExpression probe{kind, 0, value, left, right};
+        auto it = table.find(&probe);
+        if (it != table.end())
+            return *it;
+
+        probe.id = static_cast<std::uint32_t>(nodes.size());
+        // std::deque never relocates its elements, so the pointers in the table stay valid
+        nodes.push_back(probe);
+        const SharedExpression* node = &nodes.back();
+        table.insert(node);
+        return node;
+    }
+
+    std::deque<SharedExpression> nodes;
+    std::unordered_set<const SharedExpression*, NodeHash, NodeEqual> table;
+    std::size_t requested = 0;
+};
+
+// Evaluates a DAG built by an ExpressionFactory, computing every shared node only once.
+// The cache is reused between passes; a new pass just bumps the generation counter
+// instead of clearing the cache.
+class MemoizingEvaluator
+{
+public:
+    explicit MemoizingEvaluator(const ExpressionFactory& factory) : factory(factory) {}
+
+    double evaluate(const SharedExpression* e)
+    {
+        if (cache.size() < factory.size())
+            cache.resize(factory.size());
+        if (++generation == 0)
+        {
+            // the counter wrapped around, so stale entries could look current
+            for (auto& entry : cache)
+                entry.generation = 0;
+            generation = 1;
+        }
+        evaluated = 0;
+        return visit(e);
+    }
+
+    // number of nodes actually computed in the last pass
+    std::size_t computed() const { return evaluated; }
+
+private:
+    struct Entry
+    {
+        std::uint32_t generation = 0;
+        double value = 0.0;
+    };
+
+    double visit(const SharedExpression* e)
+    {
+        auto& entry = cache[e->id];
+        if (entry.generation == generation)
+            return entry.value;
+
+        double result;
+        switch (e->kind)
+        {
+            case SharedExpression::constant:
+                result = e->value;
+                break;
+            case SharedExpression::addition:
+                result = visit(e->left) + visit(e->right);
+                break;
+            case SharedExpression::subtraction:
+            default:
+                result = visit(e->left) - visit(e->right);
+                break;
+        }
+
+        entry = Entry{generation, result};
+        ++evaluated;
+        return result;
+    }
+
+    const ExpressionFactory& factory;
+    std::vector<Entry> cache;
+    std::uint32_t generation = 0;
+    std::size_t evaluated = 0;
+};
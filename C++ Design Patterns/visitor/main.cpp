@@ -1,4 +1,5 @@
 #include <iostream>
+#include "hash-consing.hpp"
 #include "intrusive-visitor.hpp"
 
 int main()
@@ -16,5 +17,27 @@ int main()
     std::cout << oss.str() << std::endl;
 
     delete e;
+
+    // The same kind of expression, hash-consed: (2+3) appears three times below but
+    // is built once, and the evaluator computes it once per pass.
+    ExpressionFactory factory;
+    auto sum = factory.add(factory.constant(2), factory.constant(3));
+    auto shared = factory.subtract(
+        factory.add(factory.constant(1), sum),
+        factory.add(sum, factory.add(factory.constant(2), factory.constant(3)))
+    );
+
+    MemoizingEvaluator evaluator{factory};
+    double value = evaluator.evaluate(shared);
+    std::cout << "(1+(2+3))-((2+3)+(2+3)) = " << value << ", "
+              << factory.requests() << " nodes requested, " << factory.size() << " built, "
+              << evaluator.computed() << " computed" << std::endl;
+
+    // 1, 2, 3, 2+3, 1+(2+3), (2+3)+(2+3) and the subtraction: every distinct node once
+    if (value != -4 || factory.size() != 7 || evaluator.computed() != factory.size())
+    {
+        std::cerr << "shared subtrees were not built or evaluated once" << std::endl;
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,111 @@
+/*
+ * Output buffer for the expression printers
+ *
+ * A small replacement for std::ostringstream used as the printers' backend.
+ * Text is appended to a growable char buffer that keeps its capacity across clear(),
+ * doubles are formatted with std::to_chars (shortest representation that round-trips,
+ * independent of the global locale) and the result is exposed as a std::string_view,
+ * so printing many expressions into the same buffer does not allocate once it has grown.
+ * The buffer can also run in measuring mode, where writes only count characters;
+ * a printer can use it for a first pass to reserve the exact output size up front.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class OutputBuffer
+{
+public:
+    OutputBuffer& operator<<(double value)
+    {
+        // 32 characters are enough for the shortest round-trip form of any double
+        char scratch[32];
+        char* first = measuring ? scratch : grow(sizeof scratch);
+        auto [last, ec] = std::to_chars(first, first + sizeof scratch, value);
+        length += static_cast<std::size_t>(last - first);
+        return *this;
+    }
+
+    OutputBuffer& operator<<(char c)
+    {
+        if (!measuring)
+            *grow(1) = c;
+        ++length;
+        return *this;
+    }
+
+    OutputBuffer& operator<<(std::string_view text)
+    {
+        if (!measuring)
+            std::memcpy(grow(text.size()), text.data(), text.size());
+        length += text.size();
+        return *this;
+    }
+
+    OutputBuffer& operator<<(const char* text)
+    {
+        return *this << std::string_view{text};
+    }
+
+    std::string_view view() const { return {data.get(), measuring ? 0 : length}; }
+    std::string str() const { return std::string{view()}; }
+    std::size_t size() const { return length; }
+    std::size_t capacity() const { return allocated; }
+
+    // empties the buffer but keeps its memory for the next expression
+    void clear() { length = 0; }
+
+    void reserve(std::size_t n)
+    {
+        if (n > allocated)
+            reallocate(n);
+    }
+
+    // Starts a counting pass: nothing is written, only size() advances.
+    void begin_measure()
+    {
+        measure_start = length;
+        measuring = true;
+    }
+
+    // Ends the counting pass, reserves room for the measured text and returns its size.
+    std::size_t end_measure()
+    {
+        std::size_t measured = length - measure_start;
+        length = measure_start;
+        measuring = false;
+        reserve(length + measured);
+        return measured;
+    }
+
+private:
+    // returns a pointer to n writable bytes at the end of the buffer
+    char* grow(std::size_t n)
+    {
+        if (length + n > allocated)
+            reallocate(std::max(allocated * 2, length + n));
+        return data.get() + length;
+    }
+
+    void reallocate(std::size_t n)
+    {
+        std::unique_ptr<char[]> bigger{new char[n]};
+        if (length)
+            std::memcpy(bigger.get(), data.get(), length);
+        data = std::move(bigger);
+        allocated = n;
+    }
+
+    std::unique_ptr<char[]> data;
+    std::size_t length = 0;
+    std::size_t allocated = 0;
+    std::size_t measure_start = 0;
+    bool measuring = false;
+};
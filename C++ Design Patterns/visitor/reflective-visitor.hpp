@@ -10,6 +10,7 @@
 
 #pragma once
 #include "intrusive-visitor.hpp"
+#include "output-buffer.hpp"
 
 struct ExpressionPrinter
 {
@@ -18,6 +19,23 @@ struct ExpressionPrinter
         return oss.str();
     }
 
+    std::string_view view() const
+    {
+        return oss.view();
+    }
+
+    void clear()
+    {
+        oss.clear();
+    }
+
+    void reserve_for(Expression* e)
+    {
+        oss.begin_measure();
+        print(e);
+        oss.end_measure();
+    }
+
     void print(Expression* e)
     {
         if (auto de = dynamic_cast<DoubleExpression*>(e))
@@ -35,5 +53,5 @@ struct ExpressionPrinter
     }
     
 private:
-    std::ostringstream oss;
+    OutputBuffer oss;
 };
\ No newline at end of file